@@ -33,18 +33,21 @@ int main()
         systemTwo.addParticle(particle);
     }
 
-    NBodyEnv::Exporter exporter("testMPI.part", 1);
     NBodyEnv::Exporter exporterTwo("test.part", 1);
 
 // MPI version
-// set number of threads
-#if defined(_OPENMP)
-    omp_set_num_threads(2);
-#endif // _OPENMP
-
     // Initialize the MPI environment
     MPI_Init(NULL, NULL);
 
+    // Share the cpus of each machine among its ranks, one pinned thread per cpu,
+    // and move the particles to the memory of the rank
+    NBodyEnv::Topology topology;
+    topology.configure();
+    system.relocate();
+
+    // Every rank writes its own part of each state in a binary snapshot
+    NBodyEnv::MPIExporter exporter("testMPI.snap", 1);
+
     // Get the number of processes
     int world_size;
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
@@ -56,6 +59,7 @@ int main()
     if (world_rank == 0)
     {
         std::cout << "Computing with mpi-openMP hybrid. Number of nodes: " << world_size << std::endl;
+        std::cout << "Suggested ranks per machine: " << topology.getSuggestedRanks() << std::endl;
 #if defined(_OPENMP)
         std::cout << "Number of threads: " << omp_get_max_threads() << std::endl;
 #endif // _OPENMP
@@ -63,11 +67,11 @@ int main()
 
     for (int i = 0; i < 1000; i++)
     {
-        if (world_rank == 0 && i % 100 == 0) // Only master exports
-            exporter.saveState(system.getParticles());
-
         system.computeMPI();
-        MPI_Barrier(MPI_COMM_WORLD);
+
+        // after the step all the ranks hold the same particles
+        if (i % 100 == 0)
+            exporter.saveState(system.getParticles());
     }
 
     exporter.close();
@@ -40,15 +40,15 @@ int main()
     NBodyEnv::Exporter exporter("testMPI.part", 1);
     NBodyEnv::Exporter exporterTwo("test.part", 1);
 
-    // set number of threads
-#if defined(_OPENMP)
-    omp_set_num_threads(8);
-#endif // _OPENMP
-
     // MPI version
     // Initialize the MPI environment
     MPI_Init(NULL, NULL);
 
+    // Threads and their cpus follow the NUMA nodes of the machine
+    NBodyEnv::Topology topology;
+    topology.configure();
+    system.relocate();
+
     // Get the number of processes
     int world_size;
     int world_rank;
@@ -72,7 +72,6 @@ int main()
         system.computeMPI();
         if (world_rank == 0 && (i % 10 == 0)) // Only master exports
             exporter.saveState(system.getParticles());
-        MPI_Barrier(MPI_COMM_WORLD);
     }
 
     auto stop = high_resolution_clock::now();
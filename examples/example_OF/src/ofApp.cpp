@@ -5,9 +5,7 @@
 void ofApp::setup()
 {
     ofBackground(0, 0, 0);
-    Parser parser = Parser("test.part", 1.0);
-    particles_ = parser.getParticles();
-    time_steps_ = parser.getTime();
+    parser_ = std::make_unique<Parser>("test.part", 1.0);
     iter_ = 0;
     scale_factor_ = 1;
 
@@ -20,7 +18,7 @@ void ofApp::setup()
 //--------------------------------------------------------------
 void ofApp::update()
 {   
-    if(iter_ == time_steps_.size() - 1)
+    if(iter_ + 1 >= parser_->getFrames())
         ResetSimulation();
     iter_++;
 }
@@ -32,11 +30,13 @@ void ofApp::draw()
     ofClear(0);
     camera_.begin();
 
+    const std::vector<Vec> &particles = parser_->getFrame(iter_);
+
     if (iter_ == 0)
     {
         Vec max = {0.0, 0.0, 0.0};
         Vec min = {0.0, 0.0, 0.0};
-        for (Vec v : particles_[iter_])
+        for (Vec v : particles)
         {
             if (v.x > max.x)
                 max.x = v.x;
@@ -80,7 +80,7 @@ void ofApp::draw()
         }
     }
 
-    for (Vec v : particles_[iter_])
+    for (Vec v : particles)
     {
         ofEnableAlphaBlending();
         // TODO: scale color with respect to mass / velocity
@@ -105,17 +105,13 @@ void ofApp::draw()
     string frame_rate = "Frame rate: " + ofToString(ofGetFrameRate(), 2);
     ofDrawBitmapString(frame_rate, 100, 135);
 
-    string timeStep = "Time step: " + ofToString((time_steps_[iter_]));
+    string timeStep = "Time step: " + ofToString(parser_->getTime(iter_));
     ofDrawBitmapString(timeStep, 100, 150);
 }
 
 void ofApp::ResetSimulation()
 {
-    particles_.clear();
-    time_steps_.clear();
-    Parser parser = Parser("test.part", 1.0);
-    particles_ = parser.getParticles();
-    time_steps_ = parser.getTime();
+    // The frames are read again from the start, the index is kept
     iter_ = 0;
     scale_factor_ = 1;
 }
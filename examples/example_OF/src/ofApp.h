@@ -3,13 +3,14 @@
 #include "ofMain.h"
 #include "Parser.hpp"
 #include "ofxBloom.h"
+#include <memory>
 #include <vector>
 
 class ofApp : public ofBaseApp
 {
 private:
-	std::vector<std::vector<Vec>> particles_;
-    std::vector<double> time_steps_;
+	// Frames are read while the simulation is shown
+	std::unique_ptr<Parser> parser_;
 	size_t iter_;
 
 	ofEasyCam camera_;
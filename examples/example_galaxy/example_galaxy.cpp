@@ -1,3 +1,4 @@
+#include "Catalog/Catalog.hpp"
 #include "Exporter/Exporter.hpp"
 #include "Functions/EulerDiscretizer.hpp"
 #include "Functions/Functions.hpp"
@@ -7,52 +8,29 @@
 #include "System/System.hpp"
 #include "TreeNode/TreeNode.hpp"
 #include <iostream>
-#include <fstream>
 #include <vector>
 
 int main()
 {
-    // Open the file
-    std::ifstream inputFile("stars.dat");
     double const kparsec = 3.085677581e19; 
     double const timeStep = 3e13;
 
-    // Check if the file is open
-    if (!inputFile.is_open())
+    // Read the stars (z, y, x in kiloparsec and vz, vy, vx) with all the threads,
+    // every star has the same mass and radius
+    NBodyEnv::Catalog stars;
+    try
     {
-        std::cerr << "Error opening file." << std::endl;
-        return 1;
+        stars = NBodyEnv::Catalog::readText("stars.dat", "z y x vz vy vx", 6.324e5, 40);
     }
-
-    const int numStars = 43802;
-
-    // Vectors to store positions and velocities
-    std::vector<double> xPositions(numStars);
-    std::vector<double> yPositions(numStars);
-    std::vector<double> zPositions(numStars);
-    std::vector<double> vxVelocities(numStars);
-    std::vector<double> vyVelocities(numStars);
-    std::vector<double> vzVelocities(numStars);
-
-    // Read data from the file
-    for (int i = 0; i < numStars; ++i)
+    catch (const std::exception &error)
     {
-        inputFile >> zPositions[i] >> yPositions[i] >> xPositions[i] >> vzVelocities[i] >> vyVelocities[i] >> vxVelocities[i];
+        std::cerr << error.what() << std::endl;
+        return 1;
     }
 
-    // Close the file
-    inputFile.close();
-
     // generate particles with such initial positions and velocities
     NBodyEnv::System<NBodyEnv::VerletDiscretizer> parallelSystem(NBodyEnv::Functions::getGravFunc(), NBodyEnv::VerletDiscretizer(), timeStep);
-    for (int i = 0; i < numStars; ++i)
-    {
-        NBodyEnv::Particle particle(
-            NBodyEnv::gravitational,
-            {xPositions[i]*kparsec, yPositions[i]*kparsec, zPositions[i]*kparsec},
-            {vxVelocities[i], vyVelocities[i], vzVelocities[i]}, 6.324e5, 40);
-        parallelSystem.addParticle(particle);
-    }
+    parallelSystem.addParticles(stars, NBodyEnv::gravitational, kparsec);
 
 #if defined(_OPENMP)
     omp_set_num_threads(16);
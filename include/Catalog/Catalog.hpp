@@ -0,0 +1,54 @@
+#ifndef CATALOG
+#define CATALOG
+
+#include "Exporter/Snapshot.hpp"
+#include "Particle/Particle.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Initial conditions of many particles, one column per field, to fill a System with
+// addParticles, which builds the particles in place from the columns. Text catalogs are mapped in memory and parsed by all the OpenMP
+// threads, each one on its own range of lines. Binary catalogs (see below) are mapped
+// and their columns copied without any parsing, a text catalog can be converted once
+// with writeBinary
+namespace NBodyEnv {
+class Catalog {
+public:
+  std::vector<double> x, y, z;
+  std::vector<double> vx, vy, vz;
+  std::vector<double> mass;
+  std::vector<double> radius;
+
+  Catalog() = default;
+  explicit Catalog(size_t count) { resize(count); }
+
+  size_t size() const { return x.size(); }
+  void resize(size_t count);
+
+  // One particle for each row, positions and velocities multiplied by the scales
+  std::vector<Particle> particles(ParticleType type, double posScale = 1.0, double velScale = 1.0) const;
+  // Same as particles, written to size() particles from out
+  void build(Particle *out, ParticleType type, double posScale = 1.0, double velScale = 1.0) const;
+
+  // Text with one particle per line, columns separated by spaces, tabs or commas.
+  // layout names the field of each column, among x y z vx vy vz mass radius, a "-"
+  // skips the column: "z y x vz vy vx" reads the stars of example_galaxy. Fields
+  // missing from the layout take the given mass and radius, or 0. Empty lines and
+  // lines starting with '#' are ignored
+  static Catalog readText(const std::string &path, const std::string &layout = "x y z vx vy vz mass radius",
+                          double mass = 0.0, double radius = 0.0);
+
+  // Binary catalog: a SnapshotHeader with CATALOG_MAGIC, the number of particles (64
+  // bits integer) and the blocks of all the x, y, z, vx, vy, vz, mass and radius
+  // (doubles, native byte order)
+  static Catalog readBinary(const std::string &path);
+  void writeBinary(const std::string &path) const;
+};
+
+constexpr char CATALOG_MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'I', 'C', 'S'};
+constexpr std::uint32_t CATALOG_VERSION = 1;
+constexpr std::uint32_t CATALOG_FIELDS = 8;
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,80 @@
+#ifndef DIAGNOSTICS
+#define DIAGNOSTICS
+
+#include "Particle/Particle.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Reduced quantities of a state, to follow the health of a run without its particles.
+// Only the visible particles count, momenta are about the origin
+namespace NBodyEnv {
+struct DiagnosticsValues {
+  double time = 0.0;
+  double mass = 0.0;
+  double kinetic = 0.0;
+  double potential = 0.0;
+  double energy = 0.0;
+  double momentum[3] = {0.0, 0.0, 0.0};
+  double angularMomentum[3] = {0.0, 0.0, 0.0};
+  // 2K / |W|, 1 for a system in virial equilibrium
+  double virial = 0.0;
+  double centre[3] = {0.0, 0.0, 0.0};
+  double centreVel[3] = {0.0, 0.0, 0.0};
+  // Radius around the centre of mass holding each fraction of the mass
+  std::vector<double> lagrangian;
+};
+
+// Computes the diagnostics of a state with all the OpenMP threads and appends them as
+// a row of a text table, "#" followed by the names of the columns on the first line:
+// time mass kinetic potential energy px py pz Lx Ly Lz virial cx cy cz cvx cvy cvz
+// and r<percent> for each Lagrangian radius. The Simulator records one row every
+// few steps (see Simulator::setDiagnostics)
+class Diagnostics {
+public:
+  // fractions of the mass of the Lagrangian radii, resume keeps an existing file
+  // to continue it from a checkpoint
+  Diagnostics(const std::string &path, const std::vector<double> &fractions = {0.1, 0.5, 0.9},
+              bool resume = false);
+  Diagnostics(const Diagnostics &) = delete;
+  Diagnostics &operator=(const Diagnostics &) = delete;
+  ~Diagnostics();
+
+  // The potential energy is a direct sum over the pairs up to sample particles,
+  // above it the sum over every pair of sample particles evenly spread in the
+  // system and all the others, scaled to the whole system
+  void setSample(size_t sample) { _sample = sample; }
+
+  const DiagnosticsValues &compute(const std::vector<Particle> &particles, double time);
+  // compute and write a row
+  void record(const std::vector<Particle> &particles, double time);
+  // Last computed values
+  const DiagnosticsValues &getValues() const { return _values; }
+
+  // Bytes written and continuation of the file from such a position, for checkpoints
+  std::uint64_t getOffset();
+  void resume(std::uint64_t offset);
+
+  void flush() { _file.flush(); }
+  void close();
+
+private:
+  std::string _path;
+  std::ofstream _file;
+  std::vector<double> _fractions;
+  size_t _sample = 4096;
+  DiagnosticsValues _values;
+
+  // Visible particles as arrays
+  std::vector<double> _x, _y, _z, _mass, _radius;
+  // Distance from the centre and mass, sorted for the Lagrangian radii
+  std::vector<std::pair<double, double>> _shells;
+
+  void load(const std::vector<Particle> &particles);
+  double potential() const;
+  void lagrangian();
+};
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,111 @@
+#ifndef CHECKPOINT
+#define CHECKPOINT
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary archives for checkpoints, used like the Boost ones through the serialize
+// methods of the classes (ar & member): numbers are copied as they are in memory,
+// vectors and strings are preceded by their size. The file starts with a 16 bytes
+// header (NBODYCKP, version, 0) and is replaced atomically when the writer commits
+namespace NBodyEnv {
+constexpr char CHECKPOINT_MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'C', 'K', 'P'};
+// Version 1 had neither the particles written by the exporter nor the diagnostics,
+// version 2 had no renderer
+constexpr std::uint32_t CHECKPOINT_VERSION = 3;
+
+class CheckpointWriter {
+public:
+  // Direction of the archive, as in the Boost ones
+  using is_loading = std::false_type;
+  using is_saving = std::true_type;
+
+  // Nothing is written to path until commit
+  explicit CheckpointWriter(const std::string &path);
+
+  template <class V> CheckpointWriter &operator&(const V &value)
+  {
+    if constexpr (std::is_arithmetic_v<V> || std::is_enum_v<V>)
+      append(&value, sizeof(value));
+    else
+      const_cast<V &>(value).serialize(*this, CHECKPOINT_VERSION);
+    return *this;
+  }
+
+  template <class V> CheckpointWriter &operator&(const std::vector<V> &values)
+  {
+    std::uint64_t size = values.size();
+    append(&size, sizeof(size));
+    if constexpr (std::is_arithmetic_v<V>)
+      append(values.data(), size * sizeof(V));
+    else
+    {
+      for (const V &value : values)
+        *this & value;
+    }
+    return *this;
+  }
+
+  CheckpointWriter &operator&(const std::string &value);
+
+  // Write the archive to a temporary file next to path, sync it and rename it to
+  // path, so that path always holds a complete checkpoint
+  void commit();
+
+private:
+  std::string _path;
+  std::vector<char> _buffer;
+
+  void append(const void *data, size_t size);
+};
+
+class CheckpointReader {
+public:
+  using is_loading = std::true_type;
+  using is_saving = std::false_type;
+
+  // Reads the whole file, throws std::runtime_error if it isn't a checkpoint
+  explicit CheckpointReader(const std::string &path);
+
+  template <class V> CheckpointReader &operator&(V &value)
+  {
+    if constexpr (std::is_arithmetic_v<V> || std::is_enum_v<V>)
+      extract(&value, sizeof(value));
+    else
+      value.serialize(*this, CHECKPOINT_VERSION);
+    return *this;
+  }
+
+  template <class V> CheckpointReader &operator&(std::vector<V> &values)
+  {
+    std::uint64_t size;
+    extract(&size, sizeof(size));
+    if (size > _buffer.size() - _offset)
+      throw std::runtime_error("CheckpointReader: " + _path + " is corrupted");
+    values.resize(size);
+    if constexpr (std::is_arithmetic_v<V>)
+      extract(values.data(), size * sizeof(V));
+    else
+    {
+      for (V &value : values)
+        *this & value;
+    }
+    return *this;
+  }
+
+  CheckpointReader &operator&(std::string &value);
+
+private:
+  std::string _path;
+  std::vector<char> _buffer;
+  size_t _offset = 0;
+
+  void extract(void *data, size_t size);
+};
+} // namespace NBodyEnv
+#endif
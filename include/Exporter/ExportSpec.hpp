@@ -0,0 +1,47 @@
+#ifndef EXPORTSPEC
+#define EXPORTSPEC
+
+#include <cstddef>
+#include <vector>
+
+// Fields of the particles an Exporter can write
+#define EXPORT_POS 1
+#define EXPORT_VEL 2
+#define EXPORT_FORCE 4
+#define EXPORT_MASS 8
+
+// What an Exporter writes: which fields, how often and of which particles. The default
+// writes the positions of all the particles at every saved state. An Exporter without
+// a spec writes positions, velocities and masses in the columnar format
+namespace NBodyEnv {
+struct ExportSpec {
+  // EXPORT_* flags, the binary and compressed formats hold positions only
+  int fields = EXPORT_POS;
+
+  // Each field is written at the saved states 0, every, 2 * every, ...
+  int posEvery = 1;
+  int velEvery = 1;
+  int forceEvery = 1;
+  int massEvery = 1;
+
+  // Particles, chosen at the first saved state and followed afterwards: the given
+  // indices, or every stride-th one from offset if there are none
+  std::vector<size_t> ids;
+  size_t stride = 1;
+  size_t offset = 0;
+  // Of those, only the ones inside the box [lo, hi] at the first saved state
+  bool region = false;
+  double lo[3] = {0.0, 0.0, 0.0};
+  double hi[3] = {0.0, 0.0, 0.0};
+  // Of those, a random fraction drawn with seed
+  double fraction = 1.0;
+  unsigned int seed = 0;
+
+  // True if every particle is written, then the particles are those of each state
+  bool allParticles() const
+  {
+    return ids.empty() && stride <= 1 && offset == 0 && !region && fraction >= 1.0;
+  }
+};
+} // namespace NBodyEnv
+#endif
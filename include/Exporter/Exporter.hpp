@@ -1,29 +1,121 @@
 #ifndef EXPORTER
 #define EXPORTER
 
+#include "Exporter/ExportSpec.hpp"
+#include "Exporter/Npy.hpp"
+#include "Exporter/Trajectory.hpp"
 #include "Particle/Particle.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+// Text lines "PART<i> x y z" after a "---<time> pos" line for each state, the header lists
+// the fields of the lines (see ExportSpec)
+#define EXPORTER_TEXT 0
+// Binary snapshots, see Snapshot.hpp and SnapshotReader
+#define EXPORTER_BINARY 1
+// Compressed trajectories with quantized positions, see Trajectory.hpp and TrajectoryReader
+#define EXPORTER_COMPRESSED 2
+// Directory of .npy arrays, one for each field (time, pos, vel, force, mass, id)
+#define EXPORTER_COLUMNS 3
+
 // class used to create an object that writes to a file the particle positions
 // over time, in order to be able to visualize the simulation
 namespace NBodyEnv {
 class Exporter {
 public:
-  Exporter(std::string path, double deltaTime) {
-    _deltaTime = deltaTime;
-    _index = 0;
-    _expFile.open(path);
-  }
-  void saveState(std::vector<NBodyEnv::Particle>);
-  void close() { _expFile.close(); }
-  ~Exporter() = default;
+  // resume keeps the content of an existing file, to continue it from a checkpoint
+  // (see Simulator::loadCheckpoint)
+  Exporter(std::string path, double deltaTime, int format = EXPORTER_TEXT, bool resume = false);
+  void saveState(const std::vector<NBodyEnv::Particle> &particles);
+  // Same as above, with the simulated time given explicitly (adaptive time step)
+  void saveState(const std::vector<NBodyEnv::Particle> &particles, double time);
+  // Write the states from a background thread: saveState only copies the positions
+  // and returns, unless frames states are already waiting or being written (2 is
+  // double buffering). 0 goes back to writing in saveState
+  void setAsync(size_t frames = 2);
+  // Fields, particles and cadence of the output (see ExportSpec), before the first
+  // saved state
+  void setSpec(const ExportSpec &spec);
+  // Compressed format only: positions are kept to precision times the size of the
+  // system, with a keyframe every keyInterval states
+  void setPrecision(double precision, int keyInterval = 32);
+  // Wait until all the saved states are in the file
+  void flush();
+  // Position of the next state: states saved so far and bytes of the file, once
+  // flushed
+  int getIndex() const { return _index; }
+  std::uint64_t getOffset();
+  // Indices of the written particles once chosen by the first state, empty if the
+  // spec writes all of them
+  const std::vector<size_t> &getSelection() const;
+  // Continue the file at a position given by the three above, what was written after
+  // it is dropped. Without the selection a subset is chosen again by the next state
+  void resume(int index, std::uint64_t offset, const std::vector<size_t> &selection = {});
+  void close();
+  ~Exporter();
 
 private:
+  std::string _path;
   std::ofstream _expFile;
   int _index;
   double _deltaTime;
+  int _format;
+
+  ExportSpec _spec;
+  // Indices of the written particles, all of them (in order) if the spec doesn't
+  // choose a subset
+  std::vector<size_t> _selection;
+  size_t _maxSelected = 0;
+  bool _selected = false;
+
+  // A frame is the frame header of the binary format followed by the fields of the
+  // written particles. Binary and compressed frames have the x, y and z blocks, so
+  // that binary frames are written with a single call, the other ones a row of each
+  // field in fields
+  struct Frame {
+    int fields = 0;
+    std::vector<double> data;
+  };
+  Frame _buffer;
+
+  // Columnar format, the arrays are created with the first state
+  NpyWriter _time;
+  NpyWriter _pos;
+  NpyWriter _vel;
+  NpyWriter _force;
+  NpyWriter _mass;
+  size_t _count = 0;
+
+  // Compressed format, used by the thread that writes the frames
+  TrajectoryEncoder _encoder;
+  std::vector<char> _encoded;
+
+  // Frames handed to the writer thread and buffers ready to be reused
+  std::thread _writer;
+  std::mutex _mutex;
+  std::condition_variable _queued;
+  std::condition_variable _written;
+  std::deque<Frame> _queue;
+  std::vector<Frame> _pool;
+  size_t _maxFrames = 0;
+  size_t _inFlight = 0;
+  bool _stop = false;
+
+  // Fields written at the saved state index
+  int dueFields(int index) const;
+  void select(const std::vector<NBodyEnv::Particle> &particles);
+  size_t particleId(size_t row) const { return _spec.allParticles() ? row : _selection[row]; }
+  void fillFrame(Frame &frame, const std::vector<NBodyEnv::Particle> &particles, double time, int fields) const;
+  void writeFrame(const Frame &frame);
+  void openColumns(size_t count);
+  void writeLoop();
+  void stopWriter();
 };
 } // namespace NBodyEnv
 #endif
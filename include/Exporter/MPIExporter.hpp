@@ -0,0 +1,42 @@
+#ifndef MPIEXPORTER
+#define MPIEXPORTER
+
+#include "Exporter/Snapshot.hpp"
+#include "MPIEngine/MPIEngine.hpp"
+#include "Particle/Particle.hpp"
+#include <string>
+#include <vector>
+
+// MPI
+#include <mpi.h>
+
+// Writes binary snapshots (see Snapshot.hpp) with MPI-IO: every rank writes the
+// positions of its own slice of the particles into the shared file, so no process
+// has to collect and write the whole system. Construction and saves are collective,
+// all the ranks must call them
+namespace NBodyEnv {
+class MPIExporter {
+public:
+  // Must be called after MPI_Init, an existing file is overwritten
+  MPIExporter(std::string path, double deltaTime);
+  MPIExporter(const MPIExporter &) = delete;
+  MPIExporter &operator=(const MPIExporter &) = delete;
+  void saveState(const std::vector<NBodyEnv::Particle> &particles);
+  // Same as above, with the simulated time given explicitly (adaptive time step)
+  void saveState(const std::vector<NBodyEnv::Particle> &particles, double time);
+  void close();
+  ~MPIExporter();
+
+private:
+  MPI_File _file;
+  bool _open;
+  int _index;
+  double _deltaTime;
+  // End of the last frame, the same on all the ranks
+  MPI_Offset _offset;
+  // Slice written by this rank
+  MPIEngine _slices;
+  std::vector<double> _buffer;
+};
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,26 @@
+#ifndef MAPPING
+#define MAPPING
+
+#include <cstddef>
+#include <string>
+
+// Read-only mapping of a whole file, shared by the readers of the library. The
+// mapping is released with the object, an empty file has no data. Errors name
+// owner, the class reading the file
+namespace NBodyEnv {
+class Mapping {
+public:
+  Mapping(const std::string &path, const std::string &owner);
+  Mapping(const Mapping &) = delete;
+  Mapping &operator=(const Mapping &) = delete;
+  ~Mapping();
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const char *_data = nullptr;
+  size_t _size = 0;
+};
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,49 @@
+#ifndef NPY
+#define NPY
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes a .npy array (numpy format 1.0) one block of rows at a time: the first dimension
+// grows with each append, the other ones are fixed. The header has a fixed size and is
+// rewritten after each append, so the file can be loaded (np.load(path, mmap_mode='r'))
+// while it is being written
+namespace NBodyEnv {
+class NpyWriter {
+public:
+  NpyWriter() = default;
+  NpyWriter(const NpyWriter &) = delete;
+  NpyWriter &operator=(const NpyWriter &) = delete;
+  ~NpyWriter() { close(); }
+
+  // descr is the numpy type ("<f8", "<i8", ...) of elements of elementSize bytes, shape
+  // the dimensions after the first one
+  void open(const std::string &path, const std::string &descr, size_t elementSize,
+            const std::vector<size_t> &shape);
+  // Open an array written by open() and keep its first rows only
+  void resume(const std::string &path, size_t elementSize, size_t rows);
+  bool isOpen() const { return _file.is_open(); }
+
+  // Append rows, each one of the elements given by the shape
+  void append(const void *data, size_t rows);
+  void flush() { _file.flush(); }
+  void close();
+
+  size_t getRows() const { return _rows; }
+  const std::vector<size_t> &getShape() const { return _shape; }
+
+private:
+  std::string _path;
+  std::fstream _file;
+  std::string _descr;
+  std::vector<size_t> _shape;
+  size_t _rowBytes = 0;
+  size_t _rows = 0;
+
+  std::string header(size_t rows) const;
+  void writeHeader();
+};
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,99 @@
+#ifndef RENDERER
+#define RENDERER
+
+#include "Exporter/Npy.hpp"
+#include "Particle/Particle.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Grayscale images frame_<index>.pgm
+#define RENDER_PGM 0
+// Grayscale images frame_<index>.png, compressed with zlib when CMake finds it
+#define RENDER_PNG 1
+// Surface density of every frame in density.npy (frames, pixelsY, pixelsX) of float32
+#define RENDER_NPY 2
+
+namespace NBodyEnv {
+// Orthographic view: the particles are projected along the cross product of right
+// and up onto the plane through centre
+struct Camera {
+  double centre[3] = {0.0, 0.0, 0.0};
+  double right[3] = {1.0, 0.0, 0.0};
+  double up[3] = {0.0, 1.0, 0.0};
+  // Extent of the image along right, 0 fits the particles of the first frame (and
+  // moves centre to the middle of them)
+  double width = 0.0;
+  size_t pixelsX = 512;
+  size_t pixelsY = 512;
+
+  template <class Archive> void serialize(Archive &ar, const unsigned int version)
+  {
+    for (int k = 0; k < 3; ++k)
+      ar & centre[k] & right[k] & up[k];
+    ar & width & pixelsX & pixelsY;
+  }
+};
+
+// Renders the mass of the particles seen by a Camera into images during the run, so
+// that movies don't need the particles on disk: the size of a frame depends only on
+// the number of pixels. Each thread deposits its particles in its own grid with
+// bilinear weights (cloud in cell), the grids are then summed. Images map the
+// surface density on a logarithmic scale, the times of the frames are in time.npy
+class Renderer {
+public:
+  // path is a directory
+  Renderer(const std::string &path, const Camera &camera = Camera(), int format = RENDER_PGM);
+  Renderer(const Renderer &) = delete;
+  Renderer &operator=(const Renderer &) = delete;
+  ~Renderer() { close(); }
+
+  // Spread each particle over a Gaussian of the given width in pixels, 0 keeps the
+  // bilinear deposit only
+  void setSmoothing(double pixels) { _smoothing = pixels; }
+  // Surface densities shown as black and white. With max = 0 each frame is scaled to
+  // its own maximum, with min = 0 to decades below max
+  void setRange(double min, double max, double decades = 4.0);
+
+  void render(const std::vector<Particle> &particles, double time);
+  // Surface density of the last frame, pixelsY rows of pixelsX values from the top
+  const std::vector<float> &getImage() const { return _image; }
+  const Camera &getCamera() const { return _camera; }
+
+  // Frames rendered and continuation from such a position with the camera used
+  // up to it, for checkpoints
+  int getIndex() const { return _index; }
+  void resume(int index, const Camera &camera);
+
+  void flush();
+  void close();
+
+private:
+  std::string _path;
+  int _format;
+  Camera _camera;
+  bool _fitted = false;
+  int _index = 0;
+
+  double _smoothing = 0.0;
+  double _min = 0.0;
+  double _max = 0.0;
+  double _decades = 4.0;
+
+  // Grid of each thread, summed in _image
+  std::vector<std::vector<double>> _grids;
+  std::vector<float> _image;
+  std::vector<unsigned char> _pixels;
+  NpyWriter _time;
+  NpyWriter _density;
+
+  void fit(const std::vector<Particle> &particles);
+  void deposit(const std::vector<Particle> &particles);
+  void smooth();
+  void toneMap();
+  std::string framePath(int index) const;
+  void writePGM() const;
+  void writePNG() const;
+};
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,32 @@
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+#include <cstdint>
+
+// Binary snapshot files: a file header followed by one frame per saved state. Each
+// frame is a frame header and the positions of all the particles as blocks of
+// doubles in native byte order (all the x, then all the y, then all the z), so that
+// frames can be written at computed offsets by many processes and read back without
+// parsing
+namespace NBodyEnv {
+struct SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  // Blocks of doubles in each frame, one value per particle in each block
+  std::uint32_t fields;
+};
+
+struct FrameHeader {
+  double time;
+  std::uint64_t count;
+};
+
+constexpr char SNAPSHOT_MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'S', 'N', 'P'};
+// Version 1 stored x, y, z of each particle together
+constexpr std::uint32_t SNAPSHOT_VERSION = 2;
+// x, y, z
+constexpr std::uint32_t SNAPSHOT_FIELDS = 3;
+
+static_assert(sizeof(SnapshotHeader) == 16 && sizeof(FrameHeader) == 16, "fixed layout on disk");
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,39 @@
+#ifndef SNAPSHOTREADER
+#define SNAPSHOTREADER
+
+#include "Exporter/Mapping.hpp"
+#include "Exporter/Snapshot.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Reads binary snapshots (see Snapshot.hpp) by mapping the file in memory: the
+// frames are found by jumping from one frame header to the next, the positions
+// are returned as pointers into the mapping and never copied or parsed. A frame
+// cut short by an interrupted run is ignored
+namespace NBodyEnv {
+class SnapshotReader {
+public:
+  explicit SnapshotReader(const std::string &path);
+  SnapshotReader(const SnapshotReader &) = delete;
+  SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+  size_t getFrames() const { return _frames.size(); }
+  double getTime(size_t frame) const { return header(frame).time; }
+  size_t getCount(size_t frame) const { return header(frame).count; }
+
+  // Blocks of getCount(frame) coordinates, valid as long as the reader
+  const double *getX(size_t frame) const { return block(frame, 0); }
+  const double *getY(size_t frame) const { return block(frame, 1); }
+  const double *getZ(size_t frame) const { return block(frame, 2); }
+
+private:
+  Mapping _file;
+  // Offset of the header of each frame
+  std::vector<size_t> _frames;
+
+  const FrameHeader &header(size_t frame) const;
+  const double *block(size_t frame, int field) const;
+};
+} // namespace NBodyEnv
+#endif
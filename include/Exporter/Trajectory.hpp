@@ -0,0 +1,114 @@
+#ifndef TRAJECTORY
+#define TRAJECTORY
+
+#include "Exporter/Mapping.hpp"
+#include "Exporter/Snapshot.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compressed trajectory files: a file header (SnapshotHeader with its own magic)
+// followed by one compressed frame per saved state. Positions are quantized on a
+// cubic grid whose spacing is a fraction (the precision) of the largest side of the
+// bounding box of a keyframe. Keyframes store the Morton order of the particles,
+// the frames after them reuse it and store the change of each quantized position
+// since the previous frame. In both cases consecutive particles in Morton order are
+// differenced again, then the values are zigzag coded, their bytes are shuffled
+// (all the lowest bytes first) and the result is compressed with zstd when available
+// or with a run length coding of the zero bytes
+namespace NBodyEnv {
+struct TrajectoryFrameHeader {
+  double time;
+  std::uint64_t count;
+  // Grid of the keyframe the frame depends on
+  double origin[3];
+  double step;
+  std::uint32_t keyframe;
+  std::uint32_t codec;
+  // Compressed bytes following the header
+  std::uint64_t bytes;
+};
+
+constexpr char TRAJECTORY_MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'T', 'R', 'J'};
+constexpr std::uint32_t TRAJECTORY_VERSION = 1;
+
+// Codecs of the frames
+constexpr std::uint32_t TRAJECTORY_RLE = 0;
+constexpr std::uint32_t TRAJECTORY_ZSTD = 1;
+
+static_assert(sizeof(TrajectoryFrameHeader) == 64, "fixed layout on disk");
+
+class TrajectoryEncoder {
+public:
+  // precision is the grid spacing relative to the bounding box, a keyframe is written
+  // every keyInterval frames and whenever the number of particles changes
+  TrajectoryEncoder(double precision = 1.0e-5, int keyInterval = 32);
+  void setPrecision(double precision, int keyInterval);
+  // The next frame is a keyframe
+  void restart() { _sinceKey = 0; }
+
+  // Append the compressed frame of count positions given as x, y and z blocks to out
+  void encode(double time, size_t count, const double *x, const double *y, const double *z,
+              std::vector<char> &out);
+
+private:
+  double _precision;
+  int _keyInterval;
+  int _sinceKey = 0;
+
+  // Grid, Morton order and quantized positions of the last frame (in Morton order)
+  double _origin[3] = {0.0, 0.0, 0.0};
+  double _step = 1.0;
+  std::vector<std::uint32_t> _order;
+  std::vector<std::int64_t> _prev;
+
+  std::vector<std::uint64_t> _words;
+  std::vector<unsigned char> _shuffled;
+  std::vector<unsigned char> _packed;
+};
+
+class TrajectoryDecoder {
+public:
+  // Decode the frame starting at frame (header and payload), the frames since the
+  // last keyframe must have been decoded in order. Returns false if it depends on a
+  // keyframe that hasn't been decoded
+  bool decode(const char *frame, std::vector<double> &x, std::vector<double> &y, std::vector<double> &z);
+
+private:
+  bool _valid = false;
+  std::vector<std::uint32_t> _order;
+  std::vector<std::int64_t> _prev;
+
+  std::vector<std::uint64_t> _words;
+  std::vector<unsigned char> _shuffled;
+};
+
+// Reads compressed trajectories, the file is mapped in memory and the frames are
+// decoded on demand. Reading the frames in order decodes each of them once, a jump
+// decodes from the keyframe before the requested frame
+class TrajectoryReader {
+public:
+  explicit TrajectoryReader(const std::string &path);
+  TrajectoryReader(const TrajectoryReader &) = delete;
+  TrajectoryReader &operator=(const TrajectoryReader &) = delete;
+
+  size_t getFrames() const { return _frames.size(); }
+  double getTime(size_t frame) const { return header(frame).time; }
+  size_t getCount(size_t frame) const { return header(frame).count; }
+
+  // Positions of the particles at frame, in their original order
+  void readFrame(size_t frame, std::vector<double> &x, std::vector<double> &y, std::vector<double> &z);
+
+private:
+  Mapping _file;
+  std::vector<size_t> _frames;
+
+  TrajectoryDecoder _decoder;
+  // Last decoded frame, -1 if none
+  long _last = -1;
+
+  TrajectoryFrameHeader header(size_t frame) const;
+};
+} // namespace NBodyEnv
+#endif
@@ -0,0 +1,89 @@
+#ifndef ADAPTIVERKDISCRETIZER
+#define ADAPTIVERKDISCRETIZER
+
+#include <vector>
+#include <functional>
+#include <Particle/Particle.hpp>
+#include <Functions/Functions.hpp>
+
+// Bogacki-Shampine 3(2)
+#define DISC_BOGSHAMP 16
+// Cash-Karp 5(4)
+#define DISC_CASHKARP 17
+// Dormand-Prince 5(4)
+#define DISC_DOPRI5 18
+
+namespace NBodyEnv {
+    // Embedded Runge-Kutta pair with per-step error estimation. Unlike RKDiscretizer it
+    // advances the whole system at once: the stages are evaluated with the accelerations
+    // of all the particles, given by the force engine of the System
+    class AdaptiveRKDiscretizer
+    {
+        public:
+            AdaptiveRKDiscretizer(int type, double absTol = 1.0e-6, double relTol = 1.0e-6);
+
+            // Advance positions and velocities by one accepted step no longer than maxStep.
+            // deltaTime is the trial step on input and the proposed next step on output,
+            // the step actually taken is returned
+            double step(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccFunction &accFunc,
+                        double &deltaTime, double maxStep);
+
+            void setTolerance(double absTol, double relTol);
+            // Smallest step before giving up and largest step ever proposed
+            void setStepBounds(double minStep, double maxStep);
+
+            // Accelerations at the end of the last accepted step
+            const std::vector<Acc> &getAcc() const { return m_k[m_fsal ? m_k.size() - 1 : 0]; }
+            int getAccepted() const { return m_accepted; }
+            int getRejected() const { return m_rejected; }
+
+            // State kept between the steps, for the checkpoints of the System
+            template <class Archive> void serialize(Archive &ar, const unsigned int version) {
+                ar & m_accepted;
+                ar & m_rejected;
+                ar & m_k;
+                ar & m_cachedPos;
+                ar & m_cacheValid;
+            }
+
+        private:
+            std::vector<std::vector<double>> m_a;
+            // Weights of the propagated solution
+            std::vector<double> m_b;
+            // Weights of the embedded solution, used only for the error estimate
+            std::vector<double> m_bHat;
+            std::vector<double> m_c;
+            // Order of the embedded solution, sets the step size controller exponent
+            int m_errOrder;
+            // Last stage is evaluated at the new state (first same as last)
+            bool m_fsal;
+
+            double m_absTol;
+            double m_relTol;
+            double m_minStep;
+            double m_maxStep;
+            int m_accepted;
+            int m_rejected;
+
+            // Stage buffers, kept between steps to avoid reallocations
+            std::vector<std::vector<Vel>> m_kPos;
+            std::vector<std::vector<Acc>> m_k;
+            std::vector<Pos> m_stagePos;
+            std::vector<Vel> m_stageVel;
+            // Positions the first stage was last evaluated at, to reuse it when possible
+            std::vector<Pos> m_cachedPos;
+            bool m_cacheValid;
+
+            // Compute the stage positions and velocities from the previous stages
+            void setStage(size_t stage, const std::vector<Pos> &pos, const std::vector<Vel> &vel, double deltaTime);
+            // Weighted RMS norm of the local error, accepted if <= 1
+            double errorNorm(const std::vector<Pos> &pos, const std::vector<Vel> &vel, double deltaTime);
+
+            void clear();
+            void setBogShamp();
+            void setCashKarp();
+            void setDopri5();
+    };
+}
+
+#endif
@@ -14,6 +14,8 @@ namespace NBodyEnv
     {
       return discretize;
     }
+    // No state between the steps, for the checkpoints of the System
+    template <class Archive> void serialize(Archive &, const unsigned int) {}
   };
 } // namespace NBodyEnv
 
@@ -2,11 +2,40 @@
 #define FUNCTIONS
 
 #include "Particle/Particle.hpp"
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <vector>
 
 namespace NBodyEnv
 {
   constexpr double G = 6.67408e-11;
+
+  // Force engine seen by the integrators: fills the accelerations of all the
+  // particles for the given positions
+  using AccFunction = std::function<void(const std::vector<Pos> &, std::vector<Acc> &)>;
+  // Derivative of the acceleration of each particle with respect to its own
+  // position (3x3 row major), used by the Newton stage solver
+  using JacFunction = std::function<void(const std::vector<Pos> &, std::vector<std::array<double, 9>> &)>;
+
+  // Force engine of the Hermite integrator: accelerations and jerks of all the
+  // particles for the given positions and velocities
+  using AccJerkFunction = std::function<void(const std::vector<Pos> &, const std::vector<Vel> &,
+                                             std::vector<Acc> &, std::vector<Jerk> &)>;
+
+  // Structure of arrays copy of the interacting particles, lets the compiler
+  // vectorize the kernels over the sources. Absorbed particles get zero mass
+  struct Sources
+  {
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> mass;
+    std::vector<double> radius;
+
+    void load(const std::vector<Pos> &pos, const std::vector<Vel> &vel, const std::vector<Particle> &particles);
+    size_t size() const { return mass.size(); }
+  };
+
   class Functions
   {
   public:
@@ -28,6 +57,17 @@ namespace NBodyEnv
     {
       return getGravTwo;
     }
+    // acceleration of the first particle due to the second one, used by the
+    // integrators that advance the whole system at once
+    static Acc getGravAcc(const Pos &, const Pos &, double, double, double);
+    // derivative of getGravAcc with respect to the first position, added to jac
+    static void getGravJac(const Pos &, const Pos &, double, double, double, std::array<double, 9> &jac);
+    // acceleration and jerk of a particle due to all the sources in a single
+    // vectorized pass, the source with index self is skipped
+    static void getGravAccJerk(const Pos &, const Vel &, double radius, size_t self, const Sources &sources,
+                               Acc &acc, Jerk &jerk);
+    // Morton key of a position inside the box [lo, hi], 21 bits per axis interleaved
+    static uint64_t mortonKey(const Pos &pos, const double lo[3], const double hi[3]);
   };
 } // namespace NBodyEnv
 
@@ -0,0 +1,54 @@
+#ifndef HERMITEDISCRETIZER
+#define HERMITEDISCRETIZER
+
+#include <vector>
+#include <Particle/Particle.hpp>
+#include <Functions/Functions.hpp>
+
+namespace NBodyEnv {
+    // Fourth order Hermite predictor-corrector (Makino & Aarseth 1992) with shared time step.
+    // Positions and velocities are predicted with the acceleration and jerk of the last step,
+    // a single evaluation of acceleration and jerk at the predicted state is then used to
+    // correct them. More corrections (P(EC)^n) can be requested, each one costs an evaluation
+    class HermiteDiscretizer
+    {
+        public:
+            HermiteDiscretizer(int corrections = 1) : m_corrections(corrections < 1 ? 1 : corrections), m_valid(false) {}
+
+            // Advance positions and velocities by one step
+            void step(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccJerkFunction &accJerkFunc, double deltaTime);
+
+            // Acceleration and jerk at the end of the last step
+            const std::vector<Acc> &getAcc() const { return m_acc; }
+            const std::vector<Jerk> &getJerk() const { return m_jerk; }
+
+            // State kept between the steps, for the checkpoints of the System: the next
+            // step starts from the acceleration and jerk of the predicted state, which
+            // can't be evaluated again from the corrected one
+            template <class Archive> void serialize(Archive &ar, const unsigned int version) {
+                ar & m_acc;
+                ar & m_jerk;
+                ar & m_lastPos;
+                ar & m_lastVel;
+                ar & m_valid;
+            }
+
+        private:
+            int m_corrections;
+
+            std::vector<Acc> m_acc;
+            std::vector<Jerk> m_jerk;
+            // State m_acc and m_jerk were evaluated at, reused if the next step starts from it
+            std::vector<Pos> m_lastPos;
+            std::vector<Vel> m_lastVel;
+            bool m_valid;
+
+            // Buffers of the predicted state and of its acceleration and jerk
+            std::vector<Pos> m_predPos;
+            std::vector<Vel> m_predVel;
+            std::vector<Acc> m_newAcc;
+            std::vector<Jerk> m_newJerk;
+    };
+}
+
+#endif
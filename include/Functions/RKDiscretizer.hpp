@@ -37,6 +37,11 @@
 // Crank Nicolson
 #define DISC_CRANKNIC 5
 
+// Stage solvers for the implicit methods. SOLVER_NEWTON is block diagonal: each particle
+// is solved with the derivative of its acceleration w.r.t. its own position only
+#define SOLVER_FIXEDPOINT 0
+#define SOLVER_NEWTON 1
+
 namespace NBodyEnv {
     class RKDiscretizer 
     {
@@ -48,32 +53,46 @@ namespace NBodyEnv {
                         break;
                     case DISC_BEULER:
                         setBeuler();
+                        break;
                     case DISC_RK4:
                         setRK4();
+                        break;
                     case DISC_IMPMID:
                         setImpMid();
+                        break;
                     case DISC_CRANKNIC:
                         setCrankNic();
+                        break;
                     case DISC_EXPMID:
                         setExpMid();
+                        break;
                     case DISC_HEUN:
                         setHeun();
+                        break;
                     case DISC_RALSTON:
                         setRalston();
+                        break;
                     case DISC_KUTTA3:
                         setKutta3();
+                        break;
                     case DISC_HEUN3:
                         setHeun3();
+                        break;
                     case DISC_WRAY3:
                         setWray3();
+                        break;
                     case DISC_RALSTON3:
                         setRalston3();
+                        break;
                     case DISC_SSPRK3:
                         setSSPRK3();
+                        break;
                     case DISC_RK38:
                         setRK38();
+                        break;
                     case DISC_RALSTON4:
                         setRalston4();
+                        break;
                     default:
                         setFeuler();
                         break;
@@ -81,14 +100,39 @@ namespace NBodyEnv {
             }
 
             // Discretize 
-            void discretize(Particle &target, Particle &particleOne, Particle &particleTwo, std::function<Force(Pos &, Pos &, double, double, double, double)> func, double deltaTime);
+            void discretize(Particle &target, const Particle &particleOne, const Particle &particleTwo, std::function<Force(Pos &, Pos &, double, double, double, double)> func, double deltaTime);
+
+            // True if the Butcher table has nonzero entries on or above the diagonal
+            bool isImplicit() const;
+
+            // Choose the stage solver of the implicit methods, the convergence tolerance
+            // (relative to the stage positions) and the maximum number of iterations
+            void setSolver(int solver, double tol = 1.0e-10, int maxIter = 50);
+
+            // Advance the whole system by one step solving the implicit stage equations.
+            // jacFunc is only used by the block-diagonal Newton solver
+            void solveImplicit(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccFunction &accFunc,
+                               const JacFunction &jacFunc, double deltaTime);
+
+            // Iterations taken by the last implicit solve
+            int getIterations() const { return m_iterations; }
+
+            // State kept between the steps, for the checkpoints of the System
+            template <class Archive> void serialize(Archive &ar, const unsigned int version) {
+                ar & m_iterations;
+            }
 
         private:
             std::vector<std::vector<double>> m_a;
             std::vector<double> m_b;
             std::vector<double> m_c;
 
-            Vel discretizeVel(Particle &, Particle &, std::function<Force(Pos &, Pos &, double, double, double, double)>, double);
+            int m_solver = SOLVER_FIXEDPOINT;
+            double m_tol = 1.0e-10;
+            int m_maxIter = 50;
+            int m_iterations = 0;
+
+            Vel discretizeVel(const Particle &, const Particle &, std::function<Force(Pos &, Pos &, double, double, double, double)>, double);
 
             // Clear all vectors
             void clear();
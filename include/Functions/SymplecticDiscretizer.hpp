@@ -0,0 +1,72 @@
+#ifndef SYMPLECTICDISCRETIZER
+#define SYMPLECTICDISCRETIZER
+
+#include <vector>
+#include <Particle/Particle.hpp>
+#include <Functions/Functions.hpp>
+
+// Leapfrog (kick-drift-kick), second order
+#define DISC_LEAPFROG 19
+// Forest-Ruth, fourth order
+#define DISC_FORESTRUTH 20
+// Position extended Forest-Ruth like (Omelyan, Mryglod, Folk), fourth order
+#define DISC_PEFRL 21
+// Yoshida triple jump composition of leapfrog, fourth order
+#define DISC_YOSHIDA4 22
+// Yoshida composition of leapfrog (solution A), sixth order
+#define DISC_YOSHIDA6 23
+
+namespace NBodyEnv {
+    // Symplectic integrators written as a sequence of drifts (positions move with the
+    // velocities) and kicks (velocities change with the accelerations). The accelerations
+    // come from the force engine of the System, so they work with direct sum, Barnes-Hut and MPI
+    class SymplecticDiscretizer
+    {
+        public:
+            SymplecticDiscretizer(int type);
+
+            // Drift/kick primitives
+            static void drift(std::vector<Pos> &pos, const std::vector<Vel> &vel, double deltaTime);
+            static void kick(std::vector<Vel> &vel, const std::vector<Acc> &acc, double deltaTime);
+
+            // Advance positions and velocities by one step
+            void step(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccFunction &accFunc, double deltaTime);
+
+            // Order of accuracy and force evaluations per step (after the first one), to trade
+            // step size against order
+            int getOrder() const { return m_order; }
+            int getForceEvaluations() const;
+
+            // Accelerations at the positions of the last kick
+            const std::vector<Acc> &getAcc() const { return m_acc; }
+
+            // State kept between the steps, for the checkpoints of the System
+            template <class Archive> void serialize(Archive &ar, const unsigned int version) {
+                ar & m_acc;
+                ar & m_accPos;
+                ar & m_accValid;
+            }
+
+        private:
+            // Step i drifts by m_drift[i] * deltaTime and then kicks by m_kick[i] * deltaTime
+            std::vector<double> m_drift;
+            std::vector<double> m_kick;
+            int m_order;
+
+            std::vector<Acc> m_acc;
+            // Positions m_acc was evaluated at, the last kick of a step is reused by the next one
+            std::vector<Pos> m_accPos;
+            bool m_accValid;
+
+            void clear();
+            // Build the coefficients composing kick-drift-kick leapfrog steps of the given weights
+            void compose(const std::vector<double> &weights);
+            void setLeapfrog();
+            void setForestRuth();
+            void setPEFRL();
+            void setYoshida4();
+            void setYoshida6();
+    };
+}
+
+#endif
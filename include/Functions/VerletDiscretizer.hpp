@@ -14,6 +14,8 @@ namespace NBodyEnv
     static std::function<void(Particle &, Particle &, double deltaTime, std::vector<Particle> &)> getDiscretizer(){return discretize;};
     static void updatePos(Particle &p, Particle &prevP, double deltaTime);
     static void updateFirsePos(Particle &p, double deltaTime);
+    // The previous state is kept by the System, nothing to save for its checkpoints
+    template <class Archive> void serialize(Archive &, const unsigned int) {}
   };
 } // namespace NBodyEnv
 
@@ -0,0 +1,117 @@
+#ifndef MPIENGINE
+#define MPIENGINE
+
+#include <vector>
+#include <Particle/Particle.hpp>
+
+// MPI
+#include <mpi.h>
+
+// MPI force engines: every rank computes the direct sum for its slice of the
+// particles reading the replicated positions, or each pair of slices is computed
+// once by one rank and the reactions travel around a ring of ranks while the
+// next pairs are computed
+#define MPIENGINE_ALLGATHER 0
+#define MPIENGINE_RING 1
+
+namespace NBodyEnv {
+    // Distribution of the particles across the MPI ranks, shared by all the discretizers.
+    // Every rank holds the whole state and owns a contiguous slice of it: the forces of the
+    // slice are computed and integrated locally, then the slices are shared with all the ranks
+    class MPIEngine
+    {
+        public:
+            MPIEngine(int engine = MPIENGINE_ALLGATHER) : m_engine(engine), m_floatDeltas(false), m_changed(true) {}
+            // Copies share the decomposition but not the persistent requests, bound to the buffers
+            MPIEngine(const MPIEngine &other);
+            MPIEngine &operator=(const MPIEngine &other);
+            ~MPIEngine();
+
+            void setEngine(int engine) { m_engine = engine; }
+            int getEngine() const { return m_engine; }
+
+            // Send the changes of positions and velocities over a step as floats instead of the
+            // new values as doubles: half the bytes, at the price of rounding the changes
+            void setFloatDeltas(bool floatDeltas) { m_floatDeltas = floatDeltas; }
+            bool getFloatDeltas() const { return m_floatDeltas; }
+
+            // The particles have been added, removed or merged: the next syncState broadcasts them.
+            // Every rank must mark the same changes, e.g. by adding the particles on all of them
+            void markChanged() { m_changed = true; }
+            // Broadcast the whole state from rank 0 if it has been marked as changed since the last
+            // exchange, so that all the ranks start from the same particles. Updates the slices
+            // and returns true if the state has been broadcast. Nothing is exchanged otherwise
+            bool syncState(std::vector<Particle> &particles);
+            // Replace the particles of every rank with the ones of rank 0. Collective: syncState
+            // calls it for the state, the callers use it for the other per particle arrays
+            // they keep in step with the state
+            void broadcastState(std::vector<Particle> &particles);
+            // Split size particles in contiguous slices, the first ranks take one particle more
+            // if the division isn't exact
+            void setSlices(size_t size);
+
+            // Slice of this rank and slices of all the ranks
+            size_t getBegin() const { return m_displs[m_rank]; }
+            size_t getEnd() const { return m_displs[m_rank] + m_counts[m_rank]; }
+            const std::vector<int> &getCounts() const { return m_counts; }
+            const std::vector<int> &getDispls() const { return m_displs; }
+
+            // Contiguous datatype of width elements of base, committed once and kept until MPI_Finalize
+            static MPI_Datatype contiguousType(MPI_Datatype base, int width);
+
+            // Share the slice of each rank of a per particle array of doubles (Pos, Vel, Acc, Jacobians...)
+            template <class V>
+            void gather(std::vector<V> &data) const
+            {
+                static_assert(sizeof(V) % sizeof(double) == 0, "sent as an array of doubles");
+                gatherDoubles(reinterpret_cast<double *>(data.data()), sizeof(V) / sizeof(double));
+            }
+            // Share positions and velocities of the slice of each rank, previous is the state at the
+            // beginning of the step (used only to send float deltas)
+            void gatherState(std::vector<Particle> &particles, const std::vector<Particle> &previous);
+
+            // Accelerations of the slice of this rank with the ring engine. Each rank computes the
+            // pairs with half of the other slices and keeps the reactions on their particles, which
+            // are passed to the right and summed up while the next pairs are computed
+            void ringAcc(const std::vector<Particle> &particles, const std::vector<Pos> &pos, std::vector<Acc> &acc);
+
+        private:
+            int m_engine;
+            bool m_floatDeltas;
+            // The particles changed since the last broadcast of the state
+            bool m_changed;
+            int m_rank = 0;
+            int m_size = 1;
+            std::vector<int> m_counts = {0};
+            std::vector<int> m_displs = {0};
+
+            // Buffers reused by every step: positions and velocities of each particle, or their deltas.
+            // The broadcast of the whole state packs each particle in m_state too
+            std::vector<double> m_state;
+            std::vector<float> m_deltas;
+
+            // Ring engine: two travelling blocks of reactions, one sent to the right while the other is
+            // received from the left, and the block that goes back to its owner at the end. The
+            // persistent requests are created once per decomposition
+            std::vector<double> m_block[2];
+            std::vector<double> m_home;
+            MPI_Request m_ringSend[2];
+            MPI_Request m_ringRecv[2];
+            MPI_Request m_homeSend;
+            MPI_Request m_homeRecv;
+            bool m_ringReady = false;
+            // Reactions of the current pairs, and their per thread partial sums
+            std::vector<double> m_reaction;
+            std::vector<double> m_partial;
+
+            void gatherDoubles(double *data, int width) const;
+            void setupRing();
+            void freeRing();
+            // Pairs of the slice of this rank with the sources [first, first + count): their accelerations
+            // are added to acc and, if reaction isn't null, the opposite ones to the reactions of the sources
+            void blockAcc(const std::vector<Particle> &particles, const std::vector<Pos> &pos, std::vector<Acc> &acc,
+                          int first, int count, double *reaction);
+    };
+}
+
+#endif
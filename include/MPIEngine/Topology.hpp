@@ -0,0 +1,56 @@
+#ifndef TOPOLOGY
+#define TOPOLOGY
+
+#include <string>
+#include <vector>
+
+// MPI
+#include <mpi.h>
+
+namespace NBodyEnv {
+    // Hybrid MPI+OpenMP execution configuration. The NUMA nodes of the machine are read from
+    // /sys (a single node with all the cpus when it isn't available), the ranks running on the
+    // same machine share them out: every rank takes the cpus of one NUMA node, or a part of
+    // them when there are more ranks than NUMA nodes, runs one OpenMP thread per cpu and pins
+    // each thread to its own cpu. Memory allocated after configure() is first touched on the
+    // NUMA node of the rank, see System::relocate()
+    class Topology
+    {
+        public:
+            // Detect the hardware, doesn't need MPI
+            Topology();
+
+            int getNodes() const { return m_nodeCpus.size(); }
+            int getSockets() const { return m_sockets; }
+            int getCpus() const;
+            const std::vector<int> &getNodeCpus(int node) const { return m_nodeCpus[node]; }
+
+            // Ranks per machine that use it best: one for each NUMA node
+            int getSuggestedRanks() const { return getNodes(); }
+
+            // Place this rank and its threads, must be called after MPI_Init by all the ranks.
+            // threads limits the threads of the rank (0 takes one per cpu), pin = false only sets
+            // the number of threads. Returns the number of threads of the rank
+            int configure(int threads = 0, bool pin = true);
+
+            // Placement chosen by configure: NUMA node and cpus of this rank, ranks on this machine
+            int getNode() const { return m_node; }
+            const std::vector<int> &getRankCpus() const { return m_rankCpus; }
+            int getLocalRanks() const { return m_localRanks; }
+
+        private:
+            // Online cpus grouped by NUMA node
+            std::vector<std::vector<int>> m_nodeCpus;
+            int m_sockets;
+
+            int m_node = 0;
+            std::vector<int> m_rankCpus;
+            int m_localRanks = 1;
+
+            // Parse a /sys list of cpus or nodes as "0-7,16-23", empty if it can't be read
+            static std::vector<int> parseList(const std::string &path);
+            static void pinThread(int cpu);
+    };
+}
+
+#endif
@@ -1,12 +1,27 @@
+#include <Catalog/Catalog.hpp>
 #include <Collisions/Boundary.hpp>
 #include <Collisions/Collisions.hpp>
 #include <Collisions/CubeBoundary.hpp>
 #include <Collisions/SphereBoundary.hpp>
+#include <Diagnostics/Diagnostics.hpp>
+#include <Exporter/Checkpoint.hpp>
+#include <Exporter/ExportSpec.hpp>
 #include <Exporter/Exporter.hpp>
+#include <Exporter/MPIExporter.hpp>
+#include <Exporter/Npy.hpp>
+#include <Exporter/Renderer.hpp>
+#include <Exporter/Snapshot.hpp>
+#include <Exporter/SnapshotReader.hpp>
+#include <Exporter/Trajectory.hpp>
+#include <Functions/AdaptiveRKDiscretizer.hpp>
 #include <Functions/EulerDiscretizer.hpp>
 #include <Functions/Functions.hpp>
+#include <Functions/HermiteDiscretizer.hpp>
 #include <Functions/RKDiscretizer.hpp>
+#include <Functions/SymplecticDiscretizer.hpp>
 #include <Functions/VerletDiscretizer.hpp>
+#include <MPIEngine/MPIEngine.hpp>
+#include <MPIEngine/Topology.hpp>
 #include <Particle/Particle.hpp>
 #include <Simulator/Simulator.hpp>
 #include <System/System.hpp>
@@ -88,6 +88,22 @@ namespace NBodyEnv
     }
   };
 
+  // Time derivative of the acceleration, used by Hermite integration
+  struct Jerk
+  {
+    double xJerk;
+    double yJerk;
+    double zJerk;
+
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int version)
+    {
+        ar & xJerk;
+        ar & yJerk;
+        ar & zJerk;
+    }
+  };
+
   class Particle
   {
   public:
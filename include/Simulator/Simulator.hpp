@@ -1,10 +1,16 @@
 #ifndef SIMULATOR
 #define SIMULATOR
 
+#include "Diagnostics/Diagnostics.hpp"
+#include "Exporter/Checkpoint.hpp"
 #include "Exporter/Exporter.hpp"
+#include "Exporter/Renderer.hpp"
 #include "Functions/VerletDiscretizer.hpp"
 #include "System/System.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <string>
 
 namespace NBodyEnv {
 template <class T> class Simulator {
@@ -17,44 +23,235 @@ public:
       : m_export(true), m_numSteps(numSteps), m_numExp(numExp), m_exporter(exp),
         m_system(sys) {}
 
+  // Run for simTime of simulated time, exporting every expTime of simulated
+  // time regardless of the number of steps (e.g. with adaptive discretizers)
+  Simulator(NBodyEnv::System<T> &sys, NBodyEnv::Exporter *exp, double simTime,
+            double expTime)
+      : m_export(exp != nullptr), m_timed(true), m_numSteps(0), m_numExp(0),
+        m_simTime(simTime), m_expTime(expTime), m_exporter(exp), m_system(sys) {}
+
   void run() {
-    if (!m_export) {
-      for (int i = 0; i < m_numSteps; i++) {
+    if (m_timed) {
+      runTimed();
+    } else if (!m_export) {
+      while (m_step < m_numSteps) {
         m_system.compute();
+        m_step++;
+        endStep();
       }
     } else {
 
-      for (int i = 0; i < m_numSteps; i++) {
+      while (m_step < m_numSteps) {
         m_system.compute();
-        if (i % m_numExp == 0) {
+        if (m_step % m_numExp == 0) {
           m_exporter->saveState(m_system.getParticles());
         }
+        m_step++;
+        endStep();
       }
+      // states saved by an asynchronous exporter are in the file when run returns
+      m_exporter->flush();
     }
+    m_step = 0;
+  }
+
+  void runTimed() {
+    // A restored run continues towards its own end
+    if (!m_resumed) {
+      m_endTime = m_system.getTime() + m_simTime;
+      m_nextExp = m_system.getTime();
+    }
+    m_resumed = false;
+
+    while (m_system.getTime() < m_endTime) {
+      if (m_export && m_system.getTime() >= m_nextExp) {
+        m_exporter->saveState(m_system.getParticles(), m_system.getTime());
+        m_nextExp += m_expTime;
+      }
+      // Adaptive discretizers don't step over the next output
+      m_system.setStopTime(m_export ? std::min(m_nextExp, m_endTime) : m_endTime);
+      m_system.compute();
+      m_step++;
+      endStep();
+    }
+
+    if (m_export && m_system.getTime() >= m_nextExp) {
+      m_exporter->saveState(m_system.getParticles(), m_system.getTime());
+    }
+    if (m_export) {
+      m_exporter->flush();
+    }
+    // Later runs don't stop at the end of this one
+    m_system.setStopTime(INFINITY);
+    m_step = 0;
   }
 
   void runBH() {
     if (!m_export) {
-      for (int i = 0; i < m_numSteps; i++) {
+      while (m_step < m_numSteps) {
         m_system.computeBH();
+        m_step++;
+        endStep();
       }
     } else {
 
-      for (int i = 0; i < m_numSteps; i++) {
+      while (m_step < m_numSteps) {
         m_system.computeBH();
-        if (i % m_numExp == 0) {
+        if (m_step % m_numExp == 0) {
           m_exporter->saveState(m_system.getParticles());
         }
+        m_step++;
+        endStep();
       }
+      m_exporter->flush();
     }
+    m_step = 0;
+  }
+
+  // Save a checkpoint to path every `every` steps of the runs, 0 disables them
+  void setCheckpoint(const std::string &path, int every) {
+    m_checkpointPath = path;
+    m_checkpointEvery = every;
   }
 
+  // Record the diagnostics of the system every `every` steps of the runs, nullptr
+  // disables them. The state before the runs can be recorded with diagnostics->record
+  void setDiagnostics(NBodyEnv::Diagnostics *diagnostics, int every) {
+    m_diagnostics = every > 0 ? diagnostics : nullptr;
+    m_diagnosticsEvery = every;
+  }
+
+  // Render an image of the system every `every` steps of the runs, nullptr
+  // disables it
+  void setRenderer(NBodyEnv::Renderer *renderer, int every) {
+    m_renderer = every > 0 ? renderer : nullptr;
+    m_rendererEvery = every;
+  }
+
+  // Save the system, the progress of the current run and the position of the
+  // exporter, of the diagnostics and of the renderer. The file is replaced atomically.
+  // With MPI only rank 0 writes it, the other ranks hold the same state
+  void saveCheckpoint(const std::string &path) {
+    if (!writesOutput()) {
+      return;
+    }
+
+    NBodyEnv::CheckpointWriter out(path);
+    out & m_step & m_endTime & m_nextExp;
+
+    int index = 0;
+    std::uint64_t offset = 0;
+    std::vector<size_t> selection;
+    if (m_exporter) {
+      offset = m_exporter->getOffset();
+      index = m_exporter->getIndex();
+      selection = m_exporter->getSelection();
+    }
+    out & index & offset & selection;
+
+    std::uint64_t diagnostics = m_diagnostics ? m_diagnostics->getOffset() : 0;
+    out & diagnostics;
+
+    int frames = 0;
+    NBodyEnv::Camera camera;
+    if (m_renderer) {
+      m_renderer->flush();
+      frames = m_renderer->getIndex();
+      camera = m_renderer->getCamera();
+    }
+    out & frames & camera;
+
+    out & m_system;
+    out.commit();
+  }
+
+  // Restore a checkpoint, the next run continues the saved one where it was and
+  // gives the same results. The simulator must be built as the saved one, with its
+  // exporter and diagnostics opened with resume and the exporter given the same spec
+  void loadCheckpoint(const std::string &path) {
+    NBodyEnv::CheckpointReader in(path);
+    in & m_step & m_endTime & m_nextExp;
+
+    int index;
+    std::uint64_t offset;
+    std::vector<size_t> selection;
+    in & index & offset & selection;
+    if (m_exporter) {
+      m_exporter->resume(index, offset, selection);
+    }
+
+    std::uint64_t diagnostics;
+    in & diagnostics;
+    if (m_diagnostics) {
+      m_diagnostics->resume(diagnostics);
+    }
+
+    int frames;
+    NBodyEnv::Camera camera;
+    in & frames & camera;
+    if (m_renderer) {
+      m_renderer->resume(frames, camera);
+    }
+
+    in & m_system;
+    m_resumed = true;
+  }
+
+  const NBodyEnv::System<T> &getSystem() const { return m_system; }
+
 private:
   bool m_export = false;
+  bool m_timed = false;
   int m_numSteps;
   int m_numExp;
+  double m_simTime = 0.0;
+  double m_expTime = 0.0;
   NBodyEnv::Exporter *m_exporter = nullptr;
   NBodyEnv::System<T> m_system;
+
+  // Progress of the current run: steps done, end and next output of a timed run
+  int m_step = 0;
+  double m_endTime = 0.0;
+  double m_nextExp = 0.0;
+  bool m_resumed = false;
+
+  std::string m_checkpointPath;
+  int m_checkpointEvery = 0;
+
+  NBodyEnv::Diagnostics *m_diagnostics = nullptr;
+  int m_diagnosticsEvery = 0;
+  NBodyEnv::Renderer *m_renderer = nullptr;
+  int m_rendererEvery = 0;
+
+  // With MPI all the ranks run the same steps on the same state, only rank 0 writes
+  // the diagnostics, the images and the checkpoints so that they don't race on the files
+  static bool writesOutput() {
+    int initialized, finalized;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    if (!initialized || finalized) {
+      return true;
+    }
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank == 0;
+  }
+
+  // After each step: diagnostics and images first, so that a checkpoint includes them
+  void endStep() {
+    if (!writesOutput()) {
+      return;
+    }
+    if (m_diagnostics && m_step % m_diagnosticsEvery == 0) {
+      m_diagnostics->record(m_system.getParticles(), m_system.getTime());
+    }
+    if (m_renderer && m_step % m_rendererEvery == 0) {
+      m_renderer->render(m_system.getParticles(), m_system.getTime());
+    }
+    if (m_checkpointEvery > 0 && m_step % m_checkpointEvery == 0) {
+      saveCheckpoint(m_checkpointPath);
+    }
+  }
 };
 } // namespace NBodyEnv
 #endif
@@ -1,23 +1,25 @@
 #ifndef SYSTEM
 #define SYSTEM
 
+#include "Catalog/Catalog.hpp"
 #include "Particle/Particle.hpp"
 #include "Functions/Functions.hpp"
 #include "Functions/RKDiscretizer.hpp"
+#include "Functions/AdaptiveRKDiscretizer.hpp"
+#include "Functions/SymplecticDiscretizer.hpp"
+#include "Functions/HermiteDiscretizer.hpp"
 #include "TreeNode/TreeNode.hpp"
+#include <cmath>
+#include <cstdint>
 #include <functional>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
 #include <vector>
 
-// Serialization 
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/archive/binary_oarchive.hpp>
-#include <boost/iostreams/stream_buffer.hpp>
-#include <boost/iostreams/stream.hpp>
-#include <boost/iostreams/device/back_inserter.hpp>
-#include <boost/serialization/vector.hpp>
-
 // MPI
+#include "MPIEngine/MPIEngine.hpp"
 #include <mpi.h>
 
 namespace NBodyEnv {
@@ -43,20 +45,153 @@ public:
   void computeMPI();
   // Barnes-Hut with OpenMP 
   void computeBH();
+  // Barnes-Hut across MPI ranks, OpenMP inside each rank
+  void computeBHMPI();
   void addParticle(Particle particle);
+  // Add many particles at once, the storage grows geometrically as with addParticle
+  void addParticles(const std::vector<Particle> &particles)
+  {
+    _systemParticles.insert(_systemParticles.end(), particles.begin(), particles.end());
+    _prevState.insert(_prevState.end(), particles.begin(), particles.end());
+    _mpi.markChanged();
+  }
+  // Add the particles of a catalog, built in place from its columns by all the threads
+  // (see Catalog::particles for the scales)
+  void addParticles(const Catalog &catalog, ParticleType type, double posScale = 1.0, double velScale = 1.0)
+  {
+    size_t first = _systemParticles.size();
+    _systemParticles.resize(first + catalog.size());
+    catalog.build(_systemParticles.data() + first, type, posScale, velScale);
+    _prevState.insert(_prevState.end(), _systemParticles.begin() + first, _systemParticles.end());
+    _mpi.markChanged();
+  }
+  // Room for count particles, so that adding them one at a time doesn't reallocate
+  void reserve(size_t count)
+  {
+    _systemParticles.reserve(count);
+    _prevState.reserve(count);
+  }
   void printParticles() const;
   const Particle &getParticle(int index) const;
   const std::vector<Particle> &getParticles() const { return _systemParticles; }
+  // Simulated time and current time step, which adaptive discretizers change
+  double getTime() const { return _time; }
+  double getDeltaTime() const { return _deltaTime; }
+  // Time a single compute call must not step over (e.g. the next output),
+  // only adaptive discretizers shorten their step to honor it
+  void setStopTime(double stopTime) { _stopTime = stopTime; }
+  // Force engine used by computeMPI for the discretizers that work on the full state
+  void setMPIEngine(int engine) { _mpi.setEngine(engine); }
+  // computeMPI of Euler, Verlet and explicit RK shares the updated slices as float
+  // deltas, halving the traffic at the cost of rounding the change of each step
+  void setMPIFloatDeltas(bool floatDeltas) { _mpi.setFloatDeltas(floatDeltas); }
+  // Reallocate the particles from the calling thread: once Topology::configure pinned
+  // it, they are first touched on the NUMA node of the rank
+  void relocate()
+  {
+    std::vector<Particle>(_systemParticles).swap(_systemParticles);
+    std::vector<Particle>(_prevState).swap(_prevState);
+  }
+
+  // Whole state of the system, for checkpoints (see CheckpointWriter): a restored
+  // system continues exactly as the saved one. The force function, the boundaries and
+  // the MPI configuration are not saved, the system must be built as the saved one
+  template <class Archive> void serialize(Archive &ar, const unsigned int version)
+  {
+    std::string discretizer = typeid(T).name();
+    std::string saved = discretizer;
+    ar & saved;
+    if (saved != discretizer)
+      throw std::runtime_error("System: the checkpoint is of a system with another discretizer");
+
+    ar & _systemParticles;
+    ar & _prevState;
+    ar & _deltaTime;
+    ar & _time;
+    ar & _stopTime;
+    ar & _bhCost;
+    ar & _discretizer;
+
+    // A restored state is broadcast again by the next distributed step
+    if (Archive::is_loading::value)
+      _mpi.markChanged();
+  }
 
 protected:
   const std::vector<Particle> &getPrevState() const { return _prevState; }
+  // Advance the whole system by one step with the accelerations given by accFunc,
+  // used by the discretizers that work on the full state
+  void integrate(const AccFunction &accFunc);
+  // Copy positions and velocities of all the particles from/to the system
+  void loadState(std::vector<Pos> &pos, std::vector<Vel> &vel) const;
+  void storeState(const std::vector<Pos> &pos, const std::vector<Vel> &vel);
+  // Force engines: accelerations of all the particles at the given positions.
+  // The direct sum can be restricted to the particles in [begin, end)
+  void directAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc, bool parallel,
+                 long unsigned int begin = 0, long unsigned int end = SIZE_MAX) const;
+  void treeAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc);
+  // Each rank computes its slice with the selected MPI engine, the slices are then
+  // shared with all the ranks. The state must be the same on all the ranks
+  void mpiAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc);
+  // Step of the discretizers that move each particle on its own (Euler, Verlet, pairwise RK):
+  // every particle of the slice, or of the whole system if not distributed, is updated by
+  // updateParticle reading the state at the beginning of the step, then finishStep is called
+  void stepParticles(bool distributed);
+  void updateParticle(long unsigned int i, const std::vector<Particle> &state, bool stockGrav);
+  void finishStep(std::vector<Particle> &state);
+  // Distributed Barnes-Hut: the particles are split in ranges of Morton keys with the same
+  // measured cost, each rank builds the tree of its own range and sends to the others the
+  // part of it they need (locally essential tree)
+  void bhmpiAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc);
+  // Acceleration and jerk with the vectorized kernel, on one node or sliced across ranks
+  void directAccJerk(const std::vector<Pos> &pos, const std::vector<Vel> &vel, std::vector<Acc> &acc,
+                     std::vector<Jerk> &jerk, bool parallel, long unsigned int begin = 0,
+                     long unsigned int end = SIZE_MAX) const;
+  void mpiAccJerk(const std::vector<Pos> &pos, const std::vector<Vel> &vel, std::vector<Acc> &acc,
+                  std::vector<Jerk> &jerk) const;
+  // Same as integrate, for discretizers that also need the jerk
+  void integrateJerk(const AccJerkFunction &accJerkFunc);
+  // Force on particle i from all the other visible particles of state, accumulated
+  // locally so that the discretizer can move the particle as soon as its row is done.
+  // The stock gravitational function is inlined, any other _func is called pairwise on
+  // copies of the sources, so that a function adding the reaction (e.g. getGravSerial)
+  // doesn't write to the state shared by the threads
+  Force rowForce(long unsigned int i, const std::vector<Particle> &state, bool stockGrav) const;
+  // True if _func is Functions::getGrav
+  bool isStockGrav() const;
+  // Force on particle i from the Barnes-Hut tree, which must already be built
+  Force treeForce(const Particle &particle) const;
+  // Per particle derivative of the direct sum acceleration w.r.t. its own position
+  void directJac(const std::vector<Pos> &pos, std::vector<std::array<double, 9>> &jac,
+                 long unsigned int begin = 0, long unsigned int end = SIZE_MAX) const;
+  // Implicit RK step on the whole system, with the force engine of one node or of all the ranks
+  void implicitStep(bool distributed);
   std::vector<NBodyEnv::Particle> _prevState;
   std::vector<NBodyEnv::Particle> _systemParticles;
+  // State at the beginning of the step being computed, kept to reuse its storage
+  std::vector<NBodyEnv::Particle> _snapshot;
+  // Positions and velocities of the discretizers that work on the full state, reused by every step
+  std::vector<Pos> _statePos;
+  std::vector<Vel> _stateVel;
   std::function<void(Particle &, Particle &)> _func;
   T _discretizer;
   double _deltaTime;
+  double _time = 0.0;
+  double _stopTime = INFINITY;
+  MPIEngine _mpi;
+  // Cost of the force computation of each particle in the last distributed Barnes-Hut step
+  std::vector<double> _bhCost;
   NBodyEnv::TreeNode m_root;
 };
+
+// Barnes-Hut across the ranks gives the accelerations of the whole state at once, only the
+// discretizers that integrate the full state with an AccFunction can use it
+template <class T> void System<T>::computeBHMPI()
+{
+  static_assert(sizeof(T) == 0, "System: computeBHMPI is available for SymplecticDiscretizer and AdaptiveRKDiscretizer only");
+}
+template <> void System<AdaptiveRKDiscretizer>::computeBHMPI();
+template <> void System<SymplecticDiscretizer>::computeBHMPI();
 } // namespace NBodyEnv
 
 #endif
@@ -85,6 +85,13 @@ namespace NBodyEnv
         
         std::vector<double> ComputeAcc(const Particle &p1, const Particle &p2) const;
 
+        // method to collect the nodes that pass the multipole acceptance criterion for every particle
+        // inside the box [min, max], opening the others down to the leaves. The result is the locally
+        // essential tree of that box, appended to essential as x, y, z, mass, radius of each pseudo-particle.
+        // Only leaves have a radius, the nodes approximated by their center of mass have zero
+        static constexpr int essentialFields = 5;
+        void ExportEssential(const std::vector<double> &max, const std::vector<double> &min, std::vector<double> &essential) const;
+
         // octants of each node
         TreeNode *m_octant[8];
 
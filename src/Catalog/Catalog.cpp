@@ -0,0 +1,213 @@
+#include "Catalog/Catalog.hpp"
+#include "Exporter/Mapping.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <omp.h>
+
+namespace NBodyEnv
+{
+  namespace
+  {
+    const char *skipBlanks(const char *cursor, const char *end)
+    {
+      while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == ',' || *cursor == '\r'))
+        ++cursor;
+      return cursor;
+    }
+
+    const char *lineEnd(const char *cursor, const char *end)
+    {
+      const char *newline = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+      return newline ? newline : end;
+    }
+
+    // Lines with something else than blanks and comments hold a particle
+    bool isParticle(const char *line, const char *end)
+    {
+      line = skipBlanks(line, end);
+      return line < end && *line != '#';
+    }
+
+    // Field of each column of the layout, -1 for the skipped ones
+    std::vector<int> parseLayout(const std::string &layout)
+    {
+      static const char *names[CATALOG_FIELDS] = {"x", "y", "z", "vx", "vy", "vz", "mass", "radius"};
+
+      std::vector<int> columns;
+      std::istringstream words(layout);
+      std::string word;
+      while (words >> word)
+      {
+        if (word == "-")
+        {
+          columns.push_back(-1);
+          continue;
+        }
+        const char **name = std::find(names, names + CATALOG_FIELDS, word);
+        if (name == names + CATALOG_FIELDS)
+          throw std::runtime_error("Catalog: unknown column " + word);
+        columns.push_back(name - names);
+      }
+      return columns;
+    }
+  } // namespace
+
+  void Catalog::resize(size_t count)
+  {
+    for (std::vector<double> *column : {&x, &y, &z, &vx, &vy, &vz, &mass, &radius})
+      column->resize(count);
+  }
+
+  std::vector<Particle> Catalog::particles(ParticleType type, double posScale, double velScale) const
+  {
+    std::vector<Particle> built(size());
+    build(built.data(), type, posScale, velScale);
+    return built;
+  }
+
+  void Catalog::build(Particle *out, ParticleType type, double posScale, double velScale) const
+  {
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < size(); ++i)
+      out[i] = Particle(type, {x[i] * posScale, y[i] * posScale, z[i] * posScale},
+                        {vx[i] * velScale, vy[i] * velScale, vz[i] * velScale}, mass[i], radius[i]);
+  }
+
+  Catalog Catalog::readText(const std::string &path, const std::string &layout, double mass, double radius)
+  {
+    std::vector<int> columns = parseLayout(layout);
+    Mapping file(path, "Catalog");
+    const char *end = file.data() + file.size();
+
+    // Ranges of whole lines, a few per thread so that uneven lines still balance
+    size_t chunks = file.size() < (1 << 20) ? 1 : 4 * omp_get_max_threads();
+    std::vector<const char *> bounds(chunks + 1, end);
+    bounds[0] = file.data();
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+      const char *start = std::max(file.data() + file.size() * chunk / chunks, bounds[chunk - 1]);
+      bounds[chunk] = start == end ? end : std::min(lineEnd(start, end) + 1, end);
+    }
+
+    // First pass: particles in each range, which give the first row of each range
+    std::vector<size_t> rows(chunks + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+      size_t count = 0;
+      for (const char *line = bounds[chunk]; line < bounds[chunk + 1];)
+      {
+        const char *next = lineEnd(line, bounds[chunk + 1]);
+        count += isParticle(line, next);
+        line = next + 1;
+      }
+      rows[chunk + 1] = count;
+    }
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+      rows[chunk + 1] += rows[chunk];
+
+    Catalog catalog(rows[chunks]);
+    std::fill(catalog.mass.begin(), catalog.mass.end(), mass);
+    std::fill(catalog.radius.begin(), catalog.radius.end(), radius);
+    double *fields[CATALOG_FIELDS] = {catalog.x.data(),  catalog.y.data(),  catalog.z.data(),    catalog.vx.data(),
+                                      catalog.vy.data(), catalog.vz.data(), catalog.mass.data(), catalog.radius.data()};
+
+    // Second pass: each range fills its own rows. Exceptions can't leave the parallel
+    // region, the first bad row of each range is kept instead
+    std::vector<std::string> errors(chunks);
+#pragma omp parallel for schedule(dynamic)
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+      size_t row = rows[chunk];
+      for (const char *line = bounds[chunk]; line < bounds[chunk + 1] && errors[chunk].empty();)
+      {
+        const char *next = lineEnd(line, bounds[chunk + 1]);
+        if (!isParticle(line, next))
+        {
+          line = next + 1;
+          continue;
+        }
+
+        const char *cursor = line;
+        for (size_t column = 0; column < columns.size(); ++column)
+        {
+          cursor = skipBlanks(cursor, next);
+          if (cursor < next && *cursor == '+')
+            ++cursor;
+          double value;
+          std::from_chars_result parsed = std::from_chars(cursor, next, value);
+          if (parsed.ec != std::errc())
+          {
+            errors[chunk] = "Catalog: particle " + std::to_string(row) + " of " + path + " has no valid column " +
+                            std::to_string(column + 1);
+            break;
+          }
+          cursor = parsed.ptr;
+          if (columns[column] >= 0)
+            fields[columns[column]][row] = value;
+        }
+        row++;
+        line = next + 1;
+      }
+    }
+
+    for (const std::string &error : errors)
+    {
+      if (!error.empty())
+        throw std::runtime_error(error);
+    }
+    return catalog;
+  }
+
+  Catalog Catalog::readBinary(const std::string &path)
+  {
+    Mapping file(path, "Catalog");
+    SnapshotHeader header;
+    std::uint64_t count = 0;
+    if (file.size() >= sizeof(header) + sizeof(count))
+    {
+      std::memcpy(&header, file.data(), sizeof(header));
+      std::memcpy(&count, file.data() + sizeof(header), sizeof(count));
+    }
+    if (file.size() < sizeof(header) + sizeof(count) ||
+        std::memcmp(header.magic, CATALOG_MAGIC, sizeof(header.magic)) != 0 || header.version != CATALOG_VERSION ||
+        header.fields != CATALOG_FIELDS)
+      throw std::runtime_error("Catalog: " + path + " is not a catalog of version " + std::to_string(CATALOG_VERSION));
+
+    size_t block = count * sizeof(double);
+    const char *data = file.data() + sizeof(header) + sizeof(count);
+    if ((file.size() - sizeof(header) - sizeof(count)) / CATALOG_FIELDS < block)
+      throw std::runtime_error("Catalog: " + path + " is cut short");
+
+    Catalog catalog(count);
+    size_t field = 0;
+    for (std::vector<double> *column : {&catalog.x, &catalog.y, &catalog.z, &catalog.vx, &catalog.vy, &catalog.vz,
+                                        &catalog.mass, &catalog.radius})
+      std::memcpy(column->data(), data + block * field++, block);
+    return catalog;
+  }
+
+  void Catalog::writeBinary(const std::string &path) const
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+      throw std::runtime_error("Catalog: cannot open " + path);
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, CATALOG_MAGIC, sizeof(header.magic));
+    header.version = CATALOG_VERSION;
+    header.fields = CATALOG_FIELDS;
+    std::uint64_t count = size();
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const std::vector<double> *column : {&x, &y, &z, &vx, &vy, &vz, &mass, &radius})
+      file.write(reinterpret_cast<const char *>(column->data()), count * sizeof(double));
+
+    if (!file.flush())
+      throw std::runtime_error("Catalog: cannot write " + path);
+  }
+} // namespace NBodyEnv
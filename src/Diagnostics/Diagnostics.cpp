@@ -0,0 +1,230 @@
+#include "Diagnostics/Diagnostics.hpp"
+#include "Functions/Functions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+
+namespace NBodyEnv
+{
+  Diagnostics::Diagnostics(const std::string &path, const std::vector<double> &fractions, bool resume)
+      : _path(path), _fractions(fractions)
+  {
+    for (double fraction : _fractions)
+    {
+      if (!(fraction > 0.0 && fraction <= 1.0))
+        throw std::runtime_error("Diagnostics: the fractions of the Lagrangian radii must be in (0, 1]");
+    }
+
+    // Opening for reading too keeps the content, the file is positioned by resume()
+    if (resume && std::filesystem::exists(path))
+    {
+      _file.open(path, std::ios::in | std::ios::out);
+      _file.seekp(0, std::ios::end);
+    }
+    else
+    {
+      _file.open(path);
+      _file << "# time mass kinetic potential energy px py pz Lx Ly Lz virial cx cy cz cvx cvy cvz";
+      for (double fraction : _fractions)
+        _file << " r" << fraction * 100;
+      _file << "\n";
+    }
+    if (!_file)
+      throw std::runtime_error("Diagnostics: cannot open " + path);
+
+    _file.precision(17);
+    _values.lagrangian.resize(_fractions.size());
+  }
+
+  Diagnostics::~Diagnostics()
+  {
+    close();
+  }
+
+  void Diagnostics::load(const std::vector<Particle> &particles)
+  {
+    _x.clear();
+    _y.clear();
+    _z.clear();
+    _mass.clear();
+    _radius.clear();
+    for (const Particle &particle : particles)
+    {
+      if (!particle.getVisible())
+        continue;
+      _x.push_back(particle.getPos().xPos);
+      _y.push_back(particle.getPos().yPos);
+      _z.push_back(particle.getPos().zPos);
+      _mass.push_back(particle.getSpecInfo());
+      _radius.push_back(particle.getRadius());
+    }
+  }
+
+  const DiagnosticsValues &Diagnostics::compute(const std::vector<Particle> &particles, double time)
+  {
+    load(particles);
+
+    double mass = 0.0, kinetic = 0.0;
+    double px = 0.0, py = 0.0, pz = 0.0;
+    double lx = 0.0, ly = 0.0, lz = 0.0;
+    double cx = 0.0, cy = 0.0, cz = 0.0;
+#pragma omp parallel for reduction(+ : mass, kinetic, px, py, pz, lx, ly, lz, cx, cy, cz)
+    for (size_t i = 0; i < particles.size(); ++i)
+    {
+      const Particle &particle = particles[i];
+      if (!particle.getVisible())
+        continue;
+      const Pos &pos = particle.getPos();
+      const Vel &vel = particle.getVel();
+      double m = particle.getSpecInfo();
+
+      mass += m;
+      kinetic += 0.5 * m * (vel.xVel * vel.xVel + vel.yVel * vel.yVel + vel.zVel * vel.zVel);
+      px += m * vel.xVel;
+      py += m * vel.yVel;
+      pz += m * vel.zVel;
+      lx += m * (pos.yPos * vel.zVel - pos.zPos * vel.yVel);
+      ly += m * (pos.zPos * vel.xVel - pos.xPos * vel.zVel);
+      lz += m * (pos.xPos * vel.yVel - pos.yPos * vel.xVel);
+      cx += m * pos.xPos;
+      cy += m * pos.yPos;
+      cz += m * pos.zPos;
+    }
+
+    _values.time = time;
+    _values.mass = mass;
+    _values.kinetic = kinetic;
+    _values.potential = potential();
+    _values.energy = kinetic + _values.potential;
+    _values.momentum[0] = px;
+    _values.momentum[1] = py;
+    _values.momentum[2] = pz;
+    _values.angularMomentum[0] = lx;
+    _values.angularMomentum[1] = ly;
+    _values.angularMomentum[2] = lz;
+    _values.virial = _values.potential != 0.0 ? 2.0 * kinetic / std::abs(_values.potential) : 0.0;
+
+    double inverse = mass > 0.0 ? 1.0 / mass : 0.0;
+    _values.centre[0] = cx * inverse;
+    _values.centre[1] = cy * inverse;
+    _values.centre[2] = cz * inverse;
+    _values.centreVel[0] = px * inverse;
+    _values.centreVel[1] = py * inverse;
+    _values.centreVel[2] = pz * inverse;
+
+    lagrangian();
+    return _values;
+  }
+
+  double Diagnostics::potential() const
+  {
+    // Pairs closer than their radii don't attract each other (see Functions::getGrav),
+    // they have no potential energy either
+    size_t count = _mass.size();
+    auto row = [this, count](size_t i, size_t begin)
+    {
+      double sum = 0.0;
+#pragma omp simd reduction(+ : sum)
+      for (size_t j = begin; j < count; ++j)
+      {
+        double dx = _x[i] - _x[j];
+        double dy = _y[i] - _y[j];
+        double dz = _z[i] - _z[j];
+        double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        bool apart = distance > _radius[i] + _radius[j] && j != i;
+        sum += apart ? _mass[j] / distance : 0.0;
+      }
+      return -G * _mass[i] * sum;
+    };
+
+    double energy = 0.0;
+    if (count <= _sample)
+    {
+#pragma omp parallel for schedule(dynamic, 16) reduction(+ : energy)
+      for (size_t i = 0; i < count; ++i)
+        energy += row(i, i + 1);
+      return energy;
+    }
+
+    // Each sampled particle stands for count / sample of them, every pair is counted twice
+    size_t stride = (count + _sample - 1) / _sample;
+    size_t sampled = (count + stride - 1) / stride;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : energy)
+    for (size_t k = 0; k < sampled; ++k)
+      energy += row(k * stride, 0);
+    return 0.5 * energy * static_cast<double>(count) / sampled;
+  }
+
+  void Diagnostics::lagrangian()
+  {
+    size_t count = _mass.size();
+    _shells.resize(count);
+    const double *centre = _values.centre;
+#pragma omp parallel for
+    for (size_t i = 0; i < count; ++i)
+    {
+      double dx = _x[i] - centre[0];
+      double dy = _y[i] - centre[1];
+      double dz = _z[i] - centre[2];
+      _shells[i] = {std::sqrt(dx * dx + dy * dy + dz * dz), _mass[i]};
+    }
+    std::sort(_shells.begin(), _shells.end());
+
+    // Fractions are reached in any order, each one with its own walk
+    for (size_t f = 0; f < _fractions.size(); ++f)
+    {
+      double target = _fractions[f] * _values.mass;
+      double enclosed = 0.0;
+      double radius = count > 0 ? _shells.back().first : 0.0;
+      for (const auto &shell : _shells)
+      {
+        enclosed += shell.second;
+        if (enclosed >= target)
+        {
+          radius = shell.first;
+          break;
+        }
+      }
+      _values.lagrangian[f] = radius;
+    }
+  }
+
+  void Diagnostics::record(const std::vector<Particle> &particles, double time)
+  {
+    compute(particles, time);
+
+    const DiagnosticsValues &v = _values;
+    _file << v.time << " " << v.mass << " " << v.kinetic << " " << v.potential << " " << v.energy;
+    for (const double *vector : {v.momentum, v.angularMomentum})
+      _file << " " << vector[0] << " " << vector[1] << " " << vector[2];
+    _file << " " << v.virial;
+    for (const double *vector : {v.centre, v.centreVel})
+      _file << " " << vector[0] << " " << vector[1] << " " << vector[2];
+    for (double radius : v.lagrangian)
+      _file << " " << radius;
+    _file << "\n";
+  }
+
+  std::uint64_t Diagnostics::getOffset()
+  {
+    _file.flush();
+    return static_cast<std::uint64_t>(_file.tellp());
+  }
+
+  void Diagnostics::resume(std::uint64_t offset)
+  {
+    _file.flush();
+    if (std::filesystem::file_size(_path) < offset)
+      throw std::runtime_error("Diagnostics: " + _path + " is shorter than the checkpoint, it must be opened with resume");
+
+    std::filesystem::resize_file(_path, offset);
+    _file.seekp(offset);
+  }
+
+  void Diagnostics::close()
+  {
+    if (_file.is_open())
+      _file.close();
+  }
+} // namespace NBodyEnv
@@ -0,0 +1,118 @@
+#include "Exporter/Checkpoint.hpp"
+#include "Exporter/Snapshot.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace NBodyEnv
+{
+  CheckpointWriter::CheckpointWriter(const std::string &path) : _path(path)
+  {
+    SnapshotHeader header;
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.fields = 0;
+    append(&header, sizeof(header));
+  }
+
+  void CheckpointWriter::append(const void *data, size_t size)
+  {
+    if (size == 0)
+      return;
+    size_t offset = _buffer.size();
+    _buffer.resize(offset + size);
+    std::memcpy(_buffer.data() + offset, data, size);
+  }
+
+  CheckpointWriter &CheckpointWriter::operator&(const std::string &value)
+  {
+    std::uint64_t size = value.size();
+    append(&size, sizeof(size));
+    append(value.data(), size);
+    return *this;
+  }
+
+  void CheckpointWriter::commit()
+  {
+    std::string temporary = _path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      throw std::runtime_error("CheckpointWriter: cannot open " + temporary);
+
+    size_t written = 0;
+    while (written < _buffer.size())
+    {
+      ssize_t result = write(fd, _buffer.data() + written, _buffer.size() - written);
+      if (result < 0 && errno == EINTR)
+        continue;
+      if (result <= 0)
+      {
+        ::close(fd);
+        std::remove(temporary.c_str());
+        throw std::runtime_error("CheckpointWriter: cannot write " + temporary);
+      }
+      written += result;
+    }
+
+    // The data must be on disk before the rename makes it the checkpoint
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    if (!synced || std::rename(temporary.c_str(), _path.c_str()) != 0)
+    {
+      std::remove(temporary.c_str());
+      throw std::runtime_error("CheckpointWriter: cannot replace " + _path);
+    }
+
+    // The rename is in the directory, which must reach the disk too for the new
+    // checkpoint to survive a power loss
+    size_t slash = _path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : _path.substr(0, slash);
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd < 0)
+      throw std::runtime_error("CheckpointWriter: cannot open the directory of " + _path);
+    synced = fsync(dirFd) == 0;
+    ::close(dirFd);
+    if (!synced)
+      throw std::runtime_error("CheckpointWriter: cannot sync the directory of " + _path);
+  }
+
+  CheckpointReader::CheckpointReader(const std::string &path) : _path(path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      throw std::runtime_error("CheckpointReader: cannot open " + path);
+    _buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    SnapshotHeader header;
+    if (_buffer.size() < sizeof(header))
+      throw std::runtime_error("CheckpointReader: " + path + " is not a checkpoint");
+    extract(&header, sizeof(header));
+    if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CHECKPOINT_VERSION)
+      throw std::runtime_error("CheckpointReader: " + path + " is not a checkpoint of version " +
+                               std::to_string(CHECKPOINT_VERSION));
+  }
+
+  void CheckpointReader::extract(void *data, size_t size)
+  {
+    if (size > _buffer.size() - _offset)
+      throw std::runtime_error("CheckpointReader: " + _path + " is truncated");
+    std::memcpy(data, _buffer.data() + _offset, size);
+    _offset += size;
+  }
+
+  CheckpointReader &CheckpointReader::operator&(std::string &value)
+  {
+    std::uint64_t size;
+    extract(&size, sizeof(size));
+    if (size > _buffer.size() - _offset)
+      throw std::runtime_error("CheckpointReader: " + _path + " is truncated");
+    value.assign(_buffer.data() + _offset, size);
+    _offset += size;
+    return *this;
+  }
+} // namespace NBodyEnv
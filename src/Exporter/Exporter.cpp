@@ -1,29 +1,519 @@
 #include "Exporter/Exporter.hpp"
+#include "Exporter/Snapshot.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace NBodyEnv
 {
-  void Exporter::saveState(std::vector<Particle> particles)
+  // Doubles taken by the frame header at the beginning of a frame
+  constexpr size_t headerFields = sizeof(FrameHeader) / sizeof(double);
+
+  Exporter::Exporter(std::string path, double deltaTime, int format, bool resume)
   {
-    // Declare time step
-    _expFile << "---" << (double)_index * _deltaTime << "\n";
+    _path = path;
+    _deltaTime = deltaTime;
+    _index = 0;
+    _format = format;
+
+    // The arrays are created with the first state, when the number of particles is known.
+    // Without a spec the columns keep every field they had before the specs existed
+    if (_format == EXPORTER_COLUMNS)
+    {
+      _spec.fields = EXPORT_POS | EXPORT_VEL | EXPORT_MASS;
+      std::filesystem::create_directories(path);
+      return;
+    }
+
+    // Opening for reading too keeps the content, the file is positioned by resume()
+    if (resume && std::filesystem::exists(path))
+    {
+      _expFile.open(path, std::ios::in | std::ios::out | std::ios::binary);
+      _expFile.seekp(0, std::ios::end);
+      return;
+    }
 
-    // For each particle
-    for (auto part = particles.begin(); part != particles.end(); part++)
+    if (_format == EXPORTER_TEXT)
     {
-      // Get particle index
-      int partInd = part - particles.begin();
+      _expFile.open(path);
+      return;
+    }
+
+    _expFile.open(path, std::ios::binary);
+
+    bool compressed = _format == EXPORTER_COMPRESSED;
+    SnapshotHeader header;
+    std::memcpy(header.magic, compressed ? TRAJECTORY_MAGIC : SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = compressed ? TRAJECTORY_VERSION : SNAPSHOT_VERSION;
+    header.fields = SNAPSHOT_FIELDS;
+    _expFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+
+  Exporter::~Exporter()
+  {
+    stopWriter();
+  }
+
+  void Exporter::saveState(const std::vector<Particle> &particles)
+  {
+    saveState(particles, (double)_index * _deltaTime);
+  }
+
+  void Exporter::saveState(const std::vector<Particle> &particles, double time)
+  {
+    select(particles);
 
-      // Output particle positions
-      _expFile << "PART" << partInd << " " << part->getPos().xPos << " "
-               << part->getPos().yPos << " " << part->getPos().zPos << "\n";
-      //     << " Force: " << part->getForce().xForce << " "
-      //     << part->getForce().yForce << " " << part->getForce().zForce
-      // _expFile  << " Vel: " << part->getVel().xVel << " " << part->getVel().yVel
-      //   << " " << part->getVel().zVel << "\n";
+    // The arrays have one row of particles for each state
+    if (_format == EXPORTER_COLUMNS)
+    {
+      if (_index > 0 && _selection.size() != _count)
+        throw std::runtime_error("Exporter: the columnar format needs the same particles in every state");
+      _count = _selection.size();
     }
 
-    // Increase index
+    int fields = dueFields(_index);
     _index++;
+
+    // The columnar format records the time of every state
+    if (fields == 0 && _format != EXPORTER_COLUMNS)
+      return;
+
+    if (!_writer.joinable())
+    {
+      fillFrame(_buffer, particles, time, fields);
+      writeFrame(_buffer);
+      return;
+    }
+
+    // Wait for a free buffer if the writer is behind, so that memory stays bounded
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _written.wait(lock, [this] { return _inFlight < _maxFrames; });
+      _inFlight++;
+      if (!_pool.empty())
+      {
+        frame = std::move(_pool.back());
+        _pool.pop_back();
+      }
+    }
+
+    fillFrame(frame, particles, time, fields);
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _queue.push_back(std::move(frame));
+    }
+    _queued.notify_one();
+  }
+
+  void Exporter::setAsync(size_t frames)
+  {
+    stopWriter();
+    if (frames == 0)
+      return;
+
+    _maxFrames = frames;
+    _writer = std::thread(&Exporter::writeLoop, this);
+  }
+
+  void Exporter::setSpec(const ExportSpec &spec)
+  {
+    if (_index > 0)
+      throw std::runtime_error("Exporter: the spec must be set before the first state");
+    if ((_format == EXPORTER_BINARY || _format == EXPORTER_COMPRESSED) && spec.fields != EXPORT_POS)
+      throw std::runtime_error("Exporter: the binary and compressed formats hold positions only");
+    if (spec.posEvery < 1 || spec.velEvery < 1 || spec.forceEvery < 1 || spec.massEvery < 1 || spec.stride < 1)
+      throw std::runtime_error("Exporter: the cadences and the stride must be positive");
+
+    _spec = spec;
+    _selection.clear();
+    _selected = false;
+  }
+
+  int Exporter::dueFields(int index) const
+  {
+    int fields = 0;
+    if ((_spec.fields & EXPORT_POS) && index % _spec.posEvery == 0)
+      fields |= EXPORT_POS;
+    if ((_spec.fields & EXPORT_VEL) && index % _spec.velEvery == 0)
+      fields |= EXPORT_VEL;
+    if ((_spec.fields & EXPORT_FORCE) && index % _spec.forceEvery == 0)
+      fields |= EXPORT_FORCE;
+    if ((_spec.fields & EXPORT_MASS) && index % _spec.massEvery == 0)
+      fields |= EXPORT_MASS;
+    return fields;
+  }
+
+  void Exporter::select(const std::vector<Particle> &particles)
+  {
+    size_t count = particles.size();
+
+    if (_spec.allParticles())
+    {
+      if (_selection.size() != count)
+      {
+        _selection.resize(count);
+        std::iota(_selection.begin(), _selection.end(), 0);
+      }
+      return;
+    }
+
+    // A subset is chosen once, the same particles are written afterwards
+    if (_selected)
+    {
+      if (!_selection.empty() && _maxSelected >= count)
+        throw std::runtime_error("Exporter: particle " + std::to_string(_maxSelected) + " is not in the system anymore");
+      return;
+    }
+
+    _selection.clear();
+    if (!_spec.ids.empty())
+    {
+      for (size_t id : _spec.ids)
+      {
+        if (id >= count)
+          throw std::runtime_error("Exporter: particle " + std::to_string(id) + " is not in the system");
+        _selection.push_back(id);
+      }
+    }
+    else
+    {
+      for (size_t id = _spec.offset; id < count; id += _spec.stride)
+        _selection.push_back(id);
+    }
+
+    if (_spec.region)
+    {
+      auto outside = [this, &particles](size_t id)
+      {
+        const Pos &pos = particles[id].getPos();
+        const double coord[3] = {pos.xPos, pos.yPos, pos.zPos};
+        for (int k = 0; k < 3; ++k)
+        {
+          if (coord[k] < _spec.lo[k] || coord[k] > _spec.hi[k])
+            return true;
+        }
+        return false;
+      };
+      _selection.erase(std::remove_if(_selection.begin(), _selection.end(), outside), _selection.end());
+    }
+
+    if (_spec.fraction < 1.0)
+    {
+      std::mt19937_64 gen(_spec.seed);
+      std::bernoulli_distribution keep(std::max(0.0, _spec.fraction));
+      _selection.erase(std::remove_if(_selection.begin(), _selection.end(), [&](size_t) { return !keep(gen); }),
+                       _selection.end());
+    }
+
+    _maxSelected = _selection.empty() ? 0 : *std::max_element(_selection.begin(), _selection.end());
+    _selected = true;
+  }
+
+  const std::vector<size_t> &Exporter::getSelection() const
+  {
+    static const std::vector<size_t> none;
+    return _spec.allParticles() ? none : _selection;
+  }
+
+  void Exporter::setPrecision(double precision, int keyInterval)
+  {
+    // The writer thread may be encoding
+    flush();
+    _encoder.setPrecision(precision, keyInterval);
+  }
+
+  void Exporter::flush()
+  {
+    if (_writer.joinable())
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _written.wait(lock, [this] { return _inFlight == 0; });
+    }
+    _expFile.flush();
+    _time.flush();
+    _pos.flush();
+    _vel.flush();
+    _force.flush();
+    _mass.flush();
+  }
+
+  std::uint64_t Exporter::getOffset()
+  {
+    flush();
+    // The arrays are positioned by the number of states
+    if (_format == EXPORTER_COLUMNS)
+      return 0;
+    return static_cast<std::uint64_t>(_expFile.tellp());
+  }
+
+  void Exporter::resume(int index, std::uint64_t offset, const std::vector<size_t> &selection)
+  {
+    flush();
+
+    _selected = !selection.empty() && !_spec.allParticles();
+    if (_selected)
+    {
+      _selection = selection;
+      _maxSelected = *std::max_element(_selection.begin(), _selection.end());
+    }
+
+    if (_format == EXPORTER_COLUMNS)
+    {
+      _index = index;
+      // Nothing saved yet
+      if (index == 0 && !std::filesystem::exists(_path + "/time.npy"))
+        return;
+
+      // A field written every k states has a row for the states 0, k, 2k, ...
+      _time.resume(_path + "/time.npy", sizeof(double), index);
+      const std::pair<NpyWriter *, int> arrays[] = {
+          {&_pos, EXPORT_POS}, {&_vel, EXPORT_VEL}, {&_force, EXPORT_FORCE}, {&_mass, EXPORT_MASS}};
+      const int every[] = {_spec.posEvery, _spec.velEvery, _spec.forceEvery, _spec.massEvery};
+      const char *names[] = {"/pos.npy", "/vel.npy", "/force.npy", "/mass.npy"};
+      for (int field = 0; field < 4; ++field)
+      {
+        if (!(_spec.fields & arrays[field].second))
+          continue;
+        arrays[field].first->resume(_path + names[field], sizeof(double), (index + every[field] - 1) / every[field]);
+        _count = arrays[field].first->getShape().front();
+      }
+      return;
+    }
+
+    if (std::filesystem::file_size(_path) < offset)
+      throw std::runtime_error("Exporter: " + _path + " is shorter than the checkpoint, it must be opened with resume");
+
+    std::filesystem::resize_file(_path, offset);
+    _expFile.seekp(offset);
+    _index = index;
+    // The frames before are not known to the encoder
+    _encoder.restart();
+  }
+
+  void Exporter::close()
+  {
+    stopWriter();
+    _expFile.close();
+    _time.close();
+    _pos.close();
+    _vel.close();
+    _force.close();
+    _mass.close();
+  }
+
+  void Exporter::stopWriter()
+  {
+    if (!_writer.joinable())
+      return;
+
+    // The writer drains the queue before leaving
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _queued.notify_one();
+    _writer.join();
+    _stop = false;
+  }
+
+  void Exporter::writeLoop()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+      _queued.wait(lock, [this] { return _stop || !_queue.empty(); });
+      if (_queue.empty())
+        return;
+
+      Frame frame = std::move(_queue.front());
+      _queue.pop_front();
+
+      lock.unlock();
+      writeFrame(frame);
+      lock.lock();
+
+      _pool.push_back(std::move(frame));
+      _inFlight--;
+      _written.notify_all();
+    }
+  }
+
+  void Exporter::fillFrame(Frame &frame, const std::vector<Particle> &particles, double time, int fields) const
+  {
+    size_t count = _selection.size();
+    FrameHeader header = {time, count};
+    frame.fields = fields;
+
+    if (_format == EXPORTER_BINARY || _format == EXPORTER_COMPRESSED)
+    {
+      frame.data.resize(headerFields + SNAPSHOT_FIELDS * count);
+      std::memcpy(frame.data.data(), &header, sizeof(header));
+
+      double *x = frame.data.data() + headerFields;
+      double *y = x + count;
+      double *z = y + count;
+      for (size_t row = 0; row < count; ++row)
+      {
+        const Pos &pos = particles[_selection[row]].getPos();
+        x[row] = pos.xPos;
+        y[row] = pos.yPos;
+        z[row] = pos.zPos;
+      }
+      return;
+    }
+
+    size_t size = headerFields;
+    size += (fields & EXPORT_POS) ? 3 * count : 0;
+    size += (fields & EXPORT_VEL) ? 3 * count : 0;
+    size += (fields & EXPORT_FORCE) ? 3 * count : 0;
+    size += (fields & EXPORT_MASS) ? count : 0;
+    frame.data.resize(size);
+    std::memcpy(frame.data.data(), &header, sizeof(header));
+
+    double *out = frame.data.data() + headerFields;
+    if (fields & EXPORT_POS)
+    {
+      for (size_t row = 0; row < count; ++row, out += 3)
+      {
+        const Pos &pos = particles[_selection[row]].getPos();
+        out[0] = pos.xPos;
+        out[1] = pos.yPos;
+        out[2] = pos.zPos;
+      }
+    }
+    if (fields & EXPORT_VEL)
+    {
+      for (size_t row = 0; row < count; ++row, out += 3)
+      {
+        const Vel &vel = particles[_selection[row]].getVel();
+        out[0] = vel.xVel;
+        out[1] = vel.yVel;
+        out[2] = vel.zVel;
+      }
+    }
+    if (fields & EXPORT_FORCE)
+    {
+      for (size_t row = 0; row < count; ++row, out += 3)
+      {
+        const Force &force = particles[_selection[row]].getForce();
+        out[0] = force.xForce;
+        out[1] = force.yForce;
+        out[2] = force.zForce;
+      }
+    }
+    if (fields & EXPORT_MASS)
+    {
+      for (size_t row = 0; row < count; ++row)
+        *out++ = particles[_selection[row]].getSpecInfo();
+    }
+  }
+
+  void Exporter::writeFrame(const Frame &frame)
+  {
+    FrameHeader header;
+    std::memcpy(&header, frame.data.data(), sizeof(header));
+    size_t count = header.count;
+    const double *data = frame.data.data() + headerFields;
+
+    if (_format == EXPORTER_COLUMNS)
+    {
+      if (!_time.isOpen())
+        openColumns(count);
+
+      _time.append(&header.time, 1);
+      const std::pair<NpyWriter *, int> arrays[] = {
+          {&_pos, EXPORT_POS}, {&_vel, EXPORT_VEL}, {&_force, EXPORT_FORCE}, {&_mass, EXPORT_MASS}};
+      for (const auto &array : arrays)
+      {
+        if (!(frame.fields & array.second))
+          continue;
+        array.first->append(data, 1);
+        data += (array.second == EXPORT_MASS ? 1 : 3) * count;
+      }
+      return;
+    }
+
+    if (_format == EXPORTER_BINARY)
+    {
+      // The whole frame is handed to the stream at once
+      _expFile.write(reinterpret_cast<const char *>(frame.data.data()), frame.data.size() * sizeof(double));
+      return;
+    }
+
+    if (_format == EXPORTER_COMPRESSED)
+    {
+      _encoded.clear();
+      _encoder.encode(header.time, count, data, data + count, data + 2 * count, _encoded);
+      _expFile.write(_encoded.data(), _encoded.size());
+      return;
+    }
+
+    // Declare time step and the fields of its lines, which differ from a state to the
+    // other when the fields are written at different cadences
+    _expFile << "---" << header.time;
+    const std::pair<int, const char *> names[] = {
+        {EXPORT_POS, "pos"}, {EXPORT_VEL, "vel"}, {EXPORT_FORCE, "force"}, {EXPORT_MASS, "mass"}};
+    for (const auto &name : names)
+    {
+      if (frame.fields & name.first)
+        _expFile << " " << name.second;
+    }
+    _expFile << "\n";
+
+    // Output the fields of each particle, positions first
+    const double *vectors[3] = {nullptr, nullptr, nullptr};
+    const double *mass = nullptr;
+    int vectorFields = 0;
+    for (int field : {EXPORT_POS, EXPORT_VEL, EXPORT_FORCE})
+    {
+      if (frame.fields & field)
+      {
+        vectors[vectorFields++] = data;
+        data += 3 * count;
+      }
+    }
+    if (frame.fields & EXPORT_MASS)
+      mass = data;
+
+    for (size_t row = 0; row < count; ++row)
+    {
+      _expFile << "PART" << particleId(row);
+      for (int field = 0; field < vectorFields; ++field)
+      {
+        const double *value = vectors[field] + 3 * row;
+        _expFile << " " << value[0] << " " << value[1] << " " << value[2];
+      }
+      if (mass)
+        _expFile << " " << mass[row];
+      _expFile << "\n";
+    }
+  }
+
+  void Exporter::openColumns(size_t count)
+  {
+    _time.open(_path + "/time.npy", "<f8", sizeof(double), {});
+    if (_spec.fields & EXPORT_POS)
+      _pos.open(_path + "/pos.npy", "<f8", sizeof(double), {count, 3});
+    if (_spec.fields & EXPORT_VEL)
+      _vel.open(_path + "/vel.npy", "<f8", sizeof(double), {count, 3});
+    if (_spec.fields & EXPORT_FORCE)
+      _force.open(_path + "/force.npy", "<f8", sizeof(double), {count, 3});
+    if (_spec.fields & EXPORT_MASS)
+      _mass.open(_path + "/mass.npy", "<f8", sizeof(double), {count});
+
+    // Index in the system of the particle of each row, the same in every state
+    std::vector<std::int64_t> ids(count);
+    for (size_t row = 0; row < count; ++row)
+      ids[row] = particleId(row);
+    NpyWriter id;
+    id.open(_path + "/id.npy", "<i8", sizeof(std::int64_t), {});
+    id.append(ids.data(), count);
   }
 } // namespace NBodyEnv
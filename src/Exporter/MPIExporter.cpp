@@ -0,0 +1,96 @@
+#include "Exporter/MPIExporter.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace NBodyEnv
+{
+  MPIExporter::MPIExporter(std::string path, double deltaTime)
+      : _open(false), _index(0), _deltaTime(deltaTime), _offset(0)
+  {
+    if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &_file) != MPI_SUCCESS)
+      throw std::runtime_error("MPIExporter: cannot open " + path);
+    _open = true;
+
+    // Drop what an older file had after the new frames
+    MPI_File_set_size(_file, 0);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.fields = SNAPSHOT_FIELDS;
+
+    MPI_File_write_at_all(_file, 0, &header, rank == 0 ? sizeof(header) : 0, MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+    _offset = sizeof(header);
+  }
+
+  MPIExporter::~MPIExporter()
+  {
+    // Closing is collective, it can't be done once MPI is finalized
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (!finalized)
+      close();
+  }
+
+  void MPIExporter::close()
+  {
+    if (!_open)
+      return;
+    MPI_File_close(&_file);
+    _open = false;
+  }
+
+  void MPIExporter::saveState(const std::vector<Particle> &particles)
+  {
+    saveState(particles, (double)_index * _deltaTime);
+  }
+
+  void MPIExporter::saveState(const std::vector<Particle> &particles, double time)
+  {
+    _slices.setSlices(particles.size());
+    size_t begin = _slices.getBegin();
+    size_t end = _slices.getEnd();
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    bool first = rank == 0;
+
+    // The frame header comes right before the x of rank 0, which writes both
+    constexpr size_t headerFields = sizeof(FrameHeader) / sizeof(double);
+    size_t skip = first ? headerFields : 0;
+    size_t count = end - begin;
+    _buffer.resize(skip + SNAPSHOT_FIELDS * count);
+
+    if (first)
+    {
+      FrameHeader header = {time, particles.size()};
+      std::memcpy(_buffer.data(), &header, sizeof(header));
+    }
+
+    double *x = _buffer.data() + skip;
+    double *y = x + count;
+    double *z = y + count;
+    for (size_t i = begin; i < end; ++i)
+    {
+      x[i - begin] = particles[i].getPos().xPos;
+      y[i - begin] = particles[i].getPos().yPos;
+      z[i - begin] = particles[i].getPos().zPos;
+    }
+
+    // One collective write for each block, every rank writes its part of it
+    MPI_Offset blockBytes = particles.size() * sizeof(double);
+    MPI_Offset blocks = _offset + sizeof(FrameHeader) + begin * sizeof(double);
+
+    MPI_File_write_at_all(_file, first ? _offset : blocks, _buffer.data(), skip + count, MPI_DOUBLE,
+                          MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(_file, blocks + blockBytes, y, count, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(_file, blocks + 2 * blockBytes, z, count, MPI_DOUBLE, MPI_STATUS_IGNORE);
+
+    _offset += sizeof(FrameHeader) + particles.size() * SNAPSHOT_FIELDS * sizeof(double);
+    _index++;
+  }
+} // namespace NBodyEnv
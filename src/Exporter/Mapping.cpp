@@ -0,0 +1,45 @@
+#include "Exporter/Mapping.hpp"
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace NBodyEnv
+{
+  Mapping::Mapping(const std::string &path, const std::string &owner)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error(owner + ": cannot open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      throw std::runtime_error(owner + ": cannot read " + path);
+    }
+    _size = info.st_size;
+    if (_size == 0)
+    {
+      ::close(fd);
+      return;
+    }
+
+    void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid without the descriptor
+    ::close(fd);
+    if (data == MAP_FAILED)
+      throw std::runtime_error(owner + ": cannot map " + path);
+    _data = static_cast<const char *>(data);
+    // Files are usually read from the start to the end
+    madvise(data, _size, MADV_SEQUENTIAL);
+  }
+
+  Mapping::~Mapping()
+  {
+    if (_data)
+      munmap(const_cast<char *>(_data), _size);
+  }
+} // namespace NBodyEnv
@@ -0,0 +1,127 @@
+#include "Exporter/Npy.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+
+namespace NBodyEnv
+{
+  namespace
+  {
+    constexpr char npyMagic[] = "\x93NUMPY";
+    // Magic, version 1.0 and length of the dictionary
+    constexpr size_t preamble = 6 + 2 + 2;
+  } // namespace
+
+  std::string NpyWriter::header(size_t rows) const
+  {
+    std::string dict = "{'descr': '" + _descr + "', 'fortran_order': False, 'shape': (" + std::to_string(rows) + ",";
+    for (size_t dim = 0; dim < _shape.size(); ++dim)
+      dict += (dim == 0 ? " " : ", ") + std::to_string(_shape[dim]);
+    dict += "), }";
+
+    // The size is the one of the largest row count, so that the header never grows. It
+    // is padded with spaces and a newline to a multiple of 64 bytes
+    size_t largest = dict.size() - std::to_string(rows).size() +
+                     std::to_string(std::numeric_limits<std::uint64_t>::max()).size();
+    size_t total = (preamble + largest + 1 + 63) / 64 * 64;
+    dict.append(total - preamble - dict.size() - 1, ' ');
+    dict.push_back('\n');
+
+    std::string bytes(npyMagic, 6);
+    bytes.push_back(1);
+    bytes.push_back(0);
+    bytes.push_back(static_cast<char>(dict.size() & 0xff));
+    bytes.push_back(static_cast<char>(dict.size() >> 8));
+    return bytes + dict;
+  }
+
+  void NpyWriter::writeHeader()
+  {
+    std::string bytes = header(_rows);
+    _file.seekp(0);
+    _file.write(bytes.data(), bytes.size());
+    _file.seekp(0, std::ios::end);
+  }
+
+  void NpyWriter::open(const std::string &path, const std::string &descr, size_t elementSize,
+                       const std::vector<size_t> &shape)
+  {
+    close();
+    _path = path;
+    _descr = descr;
+    _shape = shape;
+    _rows = 0;
+    _rowBytes = elementSize;
+    for (size_t dim : shape)
+      _rowBytes *= dim;
+
+    _file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!_file)
+      throw std::runtime_error("NpyWriter: cannot open " + path);
+    writeHeader();
+  }
+
+  void NpyWriter::resume(const std::string &path, size_t elementSize, size_t rows)
+  {
+    close();
+    _path = path;
+    _file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!_file)
+      throw std::runtime_error("NpyWriter: cannot open " + path);
+
+    // Read back the type and the dimensions after the first one
+    char start[preamble];
+    _file.read(start, preamble);
+    size_t length = static_cast<unsigned char>(start[8]) | static_cast<unsigned char>(start[9]) << 8;
+    std::string dict(length, '\0');
+    _file.read(&dict[0], length);
+    size_t descr = dict.find("'descr': '");
+    size_t shape = dict.find("'shape': (");
+    if (!_file || std::string(start, 6) != std::string(npyMagic, 6) || descr == std::string::npos ||
+        shape == std::string::npos)
+      throw std::runtime_error("NpyWriter: " + path + " is not a .npy file");
+
+    descr += 10;
+    _descr = dict.substr(descr, dict.find('\'', descr) - descr);
+    _shape.clear();
+    const char *cursor = dict.c_str() + shape + 10;
+    char *next;
+    std::strtoull(cursor, &next, 10);
+    while (*next == ',')
+    {
+      cursor = next + 1;
+      size_t dim = std::strtoull(cursor, &next, 10);
+      if (next == cursor)
+        break;
+      _shape.push_back(dim);
+    }
+    _rowBytes = elementSize;
+    for (size_t dim : _shape)
+      _rowBytes *= dim;
+
+    size_t bytes = preamble + length + rows * _rowBytes;
+    if (header(rows).size() != preamble + length || std::filesystem::file_size(path) < bytes)
+      throw std::runtime_error("NpyWriter: " + path + " has less than " + std::to_string(rows) + " rows");
+    _file.close();
+    std::filesystem::resize_file(path, bytes);
+    _file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+
+    _rows = rows;
+    writeHeader();
+  }
+
+  void NpyWriter::append(const void *data, size_t rows)
+  {
+    _file.write(static_cast<const char *>(data), rows * _rowBytes);
+    _rows += rows;
+    writeHeader();
+  }
+
+  void NpyWriter::close()
+  {
+    if (_file.is_open())
+      _file.close();
+  }
+} // namespace NBodyEnv
@@ -0,0 +1,420 @@
+#include "Exporter/Renderer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <omp.h>
+
+#ifdef NBODY_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace NBodyEnv
+{
+  namespace
+  {
+    double dot(const double a[3], const double b[3])
+    {
+      return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Orthonormal axes of the image plane
+    void axes(const Camera &camera, double right[3], double up[3])
+    {
+      double length = std::sqrt(dot(camera.right, camera.right));
+      if (length == 0.0)
+        throw std::runtime_error("Renderer: the right direction of the camera is zero");
+      for (int k = 0; k < 3; ++k)
+        right[k] = camera.right[k] / length;
+
+      double along = dot(camera.up, right);
+      for (int k = 0; k < 3; ++k)
+        up[k] = camera.up[k] - along * right[k];
+      length = std::sqrt(dot(up, up));
+      if (length == 0.0)
+        throw std::runtime_error("Renderer: the up direction of the camera is parallel to the right one");
+      for (int k = 0; k < 3; ++k)
+        up[k] /= length;
+    }
+
+    void putBig32(std::vector<unsigned char> &out, std::uint32_t value)
+    {
+      for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<unsigned char>(value >> shift));
+    }
+
+    std::uint32_t crc(const unsigned char *data, size_t size)
+    {
+#ifdef NBODY_HAVE_ZLIB
+      return crc32(0L, data, size);
+#else
+      static const std::vector<std::uint32_t> table = []
+      {
+        std::vector<std::uint32_t> entries(256);
+        for (std::uint32_t n = 0; n < 256; ++n)
+        {
+          std::uint32_t c = n;
+          for (int k = 0; k < 8; ++k)
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+          entries[n] = c;
+        }
+        return entries;
+      }();
+      std::uint32_t c = 0xffffffffu;
+      for (size_t i = 0; i < size; ++i)
+        c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+      return c ^ 0xffffffffu;
+#endif
+    }
+
+    // zlib stream of data: compressed with zlib, or stored blocks without it
+    std::vector<unsigned char> deflate(const std::vector<unsigned char> &data)
+    {
+#ifdef NBODY_HAVE_ZLIB
+      uLongf size = compressBound(data.size());
+      std::vector<unsigned char> out(size);
+      if (compress2(out.data(), &size, data.data(), data.size(), 6) != Z_OK)
+        throw std::runtime_error("Renderer: zlib failed");
+      out.resize(size);
+      return out;
+#else
+      std::vector<unsigned char> out = {0x78, 0x01};
+      size_t offset = 0;
+      do
+      {
+        size_t length = std::min<size_t>(data.size() - offset, 65535);
+        out.push_back(offset + length == data.size());
+        out.push_back(length & 0xff);
+        out.push_back(length >> 8);
+        out.push_back(~length & 0xff);
+        out.push_back((~length >> 8) & 0xff);
+        out.insert(out.end(), data.begin() + offset, data.begin() + offset + length);
+        offset += length;
+      } while (offset < data.size());
+
+      std::uint32_t a = 1, b = 0;
+      for (unsigned char byte : data)
+      {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+      }
+      putBig32(out, b << 16 | a);
+      return out;
+#endif
+    }
+
+    void putChunk(std::vector<unsigned char> &png, const char type[4], const std::vector<unsigned char> &data)
+    {
+      putBig32(png, data.size());
+      size_t start = png.size();
+      png.insert(png.end(), type, type + 4);
+      png.insert(png.end(), data.begin(), data.end());
+      putBig32(png, crc(png.data() + start, png.size() - start));
+    }
+  } // namespace
+
+  Renderer::Renderer(const std::string &path, const Camera &camera, int format)
+      : _path(path), _format(format), _camera(camera)
+  {
+    if (_camera.pixelsX == 0 || _camera.pixelsY == 0)
+      throw std::runtime_error("Renderer: the image has no pixels");
+    double right[3], up[3];
+    axes(_camera, right, up);
+
+    std::filesystem::create_directories(path);
+    _fitted = _camera.width > 0.0;
+    _image.resize(_camera.pixelsX * _camera.pixelsY);
+  }
+
+  void Renderer::setRange(double min, double max, double decades)
+  {
+    _min = min;
+    _max = max;
+    _decades = decades;
+  }
+
+  void Renderer::render(const std::vector<Particle> &particles, double time)
+  {
+    if (!_fitted)
+      fit(particles);
+    _fitted = true;
+
+    deposit(particles);
+    if (_smoothing > 0.0)
+      smooth();
+
+    // The arrays are created with the first frame, a resumed renderer continues them
+    if (!_time.isOpen())
+    {
+      _time.open(_path + "/time.npy", "<f8", sizeof(double), {});
+      if (_format == RENDER_NPY)
+        _density.open(_path + "/density.npy", "<f4", sizeof(float), {_camera.pixelsY, _camera.pixelsX});
+    }
+    _time.append(&time, 1);
+
+    if (_format == RENDER_NPY)
+      _density.append(_image.data(), 1);
+    else
+    {
+      toneMap();
+      if (_format == RENDER_PNG)
+        writePNG();
+      else
+        writePGM();
+    }
+    _index++;
+  }
+
+  void Renderer::fit(const std::vector<Particle> &particles)
+  {
+    double lo[3] = {INFINITY, INFINITY, INFINITY};
+    double hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (const Particle &particle : particles)
+    {
+      if (!particle.getVisible())
+        continue;
+      const double pos[3] = {particle.getPos().xPos, particle.getPos().yPos, particle.getPos().zPos};
+      for (int k = 0; k < 3; ++k)
+      {
+        lo[k] = std::min(lo[k], pos[k]);
+        hi[k] = std::max(hi[k], pos[k]);
+      }
+    }
+    if (lo[0] > hi[0])
+    {
+      _camera.width = 1.0;
+      return;
+    }
+
+    double right[3], up[3];
+    axes(_camera, right, up);
+    for (int k = 0; k < 3; ++k)
+      _camera.centre[k] = 0.5 * (lo[k] + hi[k]);
+
+    // Half extent of the box seen along each axis of the image
+    double halfX = 0.0, halfY = 0.0;
+    for (int k = 0; k < 3; ++k)
+    {
+      halfX += 0.5 * (hi[k] - lo[k]) * std::abs(right[k]);
+      halfY += 0.5 * (hi[k] - lo[k]) * std::abs(up[k]);
+    }
+    double aspect = static_cast<double>(_camera.pixelsX) / _camera.pixelsY;
+    _camera.width = 2.1 * std::max(halfX, halfY * aspect);
+    if (_camera.width == 0.0)
+      _camera.width = 1.0;
+  }
+
+  void Renderer::deposit(const std::vector<Particle> &particles)
+  {
+    size_t width = _camera.pixelsX;
+    size_t height = _camera.pixelsY;
+    double pixel = _camera.width / width;
+    double right[3], up[3];
+    axes(_camera, right, up);
+    const double *centre = _camera.centre;
+
+    _grids.resize(omp_get_max_threads());
+    size_t threads = 1;
+#pragma omp parallel
+    {
+#pragma omp single
+      threads = omp_get_num_threads();
+
+      // Each thread touches its grid first, which keeps it on its NUMA node
+      std::vector<double> &grid = _grids[omp_get_thread_num()];
+      grid.assign(width * height, 0.0);
+
+#pragma omp for schedule(static)
+      for (size_t i = 0; i < particles.size(); ++i)
+      {
+        const Particle &particle = particles[i];
+        if (!particle.getVisible())
+          continue;
+        const double offset[3] = {particle.getPos().xPos - centre[0], particle.getPos().yPos - centre[1],
+                                  particle.getPos().zPos - centre[2]};
+
+        // Position in pixels, from the centre of the top left pixel
+        double x = dot(offset, right) / pixel + 0.5 * width - 0.5;
+        double y = 0.5 * height - 0.5 - dot(offset, up) / pixel;
+        double left = std::floor(x);
+        double top = std::floor(y);
+        if (left < -1.0 || top < -1.0 || left >= width || top >= height)
+          continue;
+
+        double wx = x - left;
+        double wy = y - top;
+        double mass = particle.getSpecInfo();
+        const double weights[4] = {(1 - wx) * (1 - wy), wx * (1 - wy), (1 - wx) * wy, wx * wy};
+        const long columns[4] = {long(left), long(left) + 1, long(left), long(left) + 1};
+        const long rows[4] = {long(top), long(top), long(top) + 1, long(top) + 1};
+        for (int k = 0; k < 4; ++k)
+        {
+          if (columns[k] >= 0 && columns[k] < long(width) && rows[k] >= 0 && rows[k] < long(height))
+            grid[rows[k] * width + columns[k]] += mass * weights[k];
+        }
+      }
+    }
+
+    // Mass per unit area
+    double inverseArea = 1.0 / (pixel * pixel);
+#pragma omp parallel for schedule(static)
+    for (size_t p = 0; p < width * height; ++p)
+    {
+      double sum = 0.0;
+      for (size_t t = 0; t < threads; ++t)
+        sum += _grids[t][p];
+      _image[p] = static_cast<float>(sum * inverseArea);
+    }
+  }
+
+  void Renderer::smooth()
+  {
+    // Separable Gaussian, cut at three widths
+    long radius = static_cast<long>(std::ceil(3.0 * _smoothing));
+    std::vector<double> kernel(2 * radius + 1);
+    double total = 0.0;
+    for (long k = -radius; k <= radius; ++k)
+      total += kernel[k + radius] = std::exp(-0.5 * k * k / (_smoothing * _smoothing));
+    for (double &weight : kernel)
+      weight /= total;
+
+    long width = _camera.pixelsX;
+    long height = _camera.pixelsY;
+    std::vector<float> rows(_image.size());
+#pragma omp parallel for schedule(static)
+    for (long y = 0; y < height; ++y)
+    {
+      for (long x = 0; x < width; ++x)
+      {
+        double sum = 0.0;
+        for (long k = std::max(-radius, -x); k <= std::min(radius, width - 1 - x); ++k)
+          sum += kernel[k + radius] * _image[y * width + x + k];
+        rows[y * width + x] = static_cast<float>(sum);
+      }
+    }
+#pragma omp parallel for schedule(static)
+    for (long y = 0; y < height; ++y)
+    {
+      for (long x = 0; x < width; ++x)
+      {
+        double sum = 0.0;
+        for (long k = std::max(-radius, -y); k <= std::min(radius, height - 1 - y); ++k)
+          sum += kernel[k + radius] * rows[(y + k) * width + x];
+        _image[y * width + x] = static_cast<float>(sum);
+      }
+    }
+  }
+
+  void Renderer::toneMap()
+  {
+    double max = _max;
+    if (max <= 0.0)
+    {
+      max = 0.0;
+#pragma omp parallel for reduction(max : max)
+      for (size_t p = 0; p < _image.size(); ++p)
+        max = std::max(max, static_cast<double>(_image[p]));
+    }
+    double min = _min > 0.0 ? _min : max * std::pow(10.0, -_decades);
+
+    _pixels.resize(_image.size());
+    if (max <= 0.0 || min >= max)
+    {
+      std::fill(_pixels.begin(), _pixels.end(), 0);
+      return;
+    }
+
+    double logMin = std::log10(min);
+    double scale = 255.0 / (std::log10(max) - logMin);
+#pragma omp parallel for schedule(static)
+    for (size_t p = 0; p < _image.size(); ++p)
+    {
+      double value = _image[p] > min ? (std::log10(_image[p]) - logMin) * scale : 0.0;
+      _pixels[p] = static_cast<unsigned char>(std::min(255.0, value + 0.5));
+    }
+  }
+
+  std::string Renderer::framePath(int index) const
+  {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame_%05d.%s", index, _format == RENDER_PNG ? "png" : "pgm");
+    return _path + name;
+  }
+
+  void Renderer::writePGM() const
+  {
+    std::ofstream file(framePath(_index), std::ios::binary | std::ios::trunc);
+    file << "P5\n" << _camera.pixelsX << " " << _camera.pixelsY << "\n255\n";
+    file.write(reinterpret_cast<const char *>(_pixels.data()), _pixels.size());
+    if (!file)
+      throw std::runtime_error("Renderer: cannot write " + framePath(_index));
+  }
+
+  void Renderer::writePNG() const
+  {
+    size_t width = _camera.pixelsX;
+    size_t height = _camera.pixelsY;
+
+    // Each row stores the difference with the pixel on its left (filter 1), which
+    // the compression turns into few bytes where the image is smooth
+    std::vector<unsigned char> rows((width + 1) * height);
+    for (size_t y = 0; y < height; ++y)
+    {
+      unsigned char *row = rows.data() + y * (width + 1);
+      const unsigned char *pixels = _pixels.data() + y * width;
+      row[0] = 1;
+      for (size_t x = 0; x < width; ++x)
+        row[x + 1] = pixels[x] - (x > 0 ? pixels[x - 1] : 0);
+    }
+
+    std::vector<unsigned char> header;
+    putBig32(header, width);
+    putBig32(header, height);
+    // 8 bits grayscale, no interlacing
+    header.insert(header.end(), {8, 0, 0, 0, 0});
+
+    std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    putChunk(png, "IHDR", header);
+    putChunk(png, "IDAT", deflate(rows));
+    putChunk(png, "IEND", {});
+
+    std::ofstream file(framePath(_index), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(png.data()), png.size());
+    if (!file)
+      throw std::runtime_error("Renderer: cannot write " + framePath(_index));
+  }
+
+  void Renderer::resume(int index, const Camera &camera)
+  {
+    close();
+    _camera = camera;
+    _index = index;
+    _fitted = _camera.width > 0.0;
+    _image.resize(_camera.pixelsX * _camera.pixelsY);
+
+    // Frames after the checkpoint are rendered again
+    if (index > 0 || std::filesystem::exists(_path + "/time.npy"))
+    {
+      _time.resume(_path + "/time.npy", sizeof(double), index);
+      if (_format == RENDER_NPY)
+        _density.resume(_path + "/density.npy", sizeof(float), index);
+    }
+    for (int frame = index; _format != RENDER_NPY && std::filesystem::exists(framePath(frame)); ++frame)
+      std::filesystem::remove(framePath(frame));
+  }
+
+  void Renderer::flush()
+  {
+    _time.flush();
+    _density.flush();
+  }
+
+  void Renderer::close()
+  {
+    _time.close();
+    _density.close();
+  }
+} // namespace NBodyEnv
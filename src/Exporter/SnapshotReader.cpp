@@ -0,0 +1,43 @@
+#include "Exporter/SnapshotReader.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace NBodyEnv
+{
+  SnapshotReader::SnapshotReader(const std::string &path) : _file(path, "SnapshotReader")
+  {
+    if (_file.size() < sizeof(SnapshotHeader))
+      throw std::runtime_error("SnapshotReader: " + path + " is not a snapshot");
+
+    SnapshotHeader fileHeader;
+    std::memcpy(&fileHeader, _file.data(), sizeof(fileHeader));
+    if (std::memcmp(fileHeader.magic, SNAPSHOT_MAGIC, sizeof(fileHeader.magic)) != 0 ||
+        fileHeader.version != SNAPSHOT_VERSION || fileHeader.fields != SNAPSHOT_FIELDS)
+      throw std::runtime_error("SnapshotReader: " + path + " is not a snapshot of version " +
+                               std::to_string(SNAPSHOT_VERSION));
+
+    size_t offset = sizeof(SnapshotHeader);
+    while (offset + sizeof(FrameHeader) <= _file.size())
+    {
+      FrameHeader frame;
+      std::memcpy(&frame, _file.data() + offset, sizeof(frame));
+      size_t length = sizeof(FrameHeader) + frame.count * SNAPSHOT_FIELDS * sizeof(double);
+      if (length > _file.size() - offset)
+        break;
+
+      _frames.push_back(offset);
+      offset += length;
+    }
+  }
+
+  const FrameHeader &SnapshotReader::header(size_t frame) const
+  {
+    return *reinterpret_cast<const FrameHeader *>(_file.data() + _frames.at(frame));
+  }
+
+  const double *SnapshotReader::block(size_t frame, int field) const
+  {
+    const double *blocks = reinterpret_cast<const double *>(_file.data() + _frames.at(frame) + sizeof(FrameHeader));
+    return blocks + field * header(frame).count;
+  }
+} // namespace NBodyEnv
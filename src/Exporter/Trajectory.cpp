@@ -0,0 +1,318 @@
+#include "Exporter/Trajectory.hpp"
+#include "Functions/Functions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#if defined(NBODY_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace NBodyEnv
+{
+  namespace
+  {
+    // Small values of either sign become small unsigned values
+    uint64_t zigzag(int64_t value)
+    {
+      return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value)
+    {
+      return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Byte k of every word goes to plane k, the high bytes of small values make long
+    // runs of zeros
+    void shuffle(const std::vector<uint64_t> &words, std::vector<unsigned char> &bytes)
+    {
+      size_t count = words.size();
+      bytes.resize(count * sizeof(uint64_t));
+      for (size_t plane = 0; plane < sizeof(uint64_t); ++plane)
+      {
+        unsigned char *out = bytes.data() + plane * count;
+        for (size_t i = 0; i < count; ++i)
+          out[i] = static_cast<unsigned char>(words[i] >> (8 * plane));
+      }
+    }
+
+    void unshuffle(const std::vector<unsigned char> &bytes, std::vector<uint64_t> &words)
+    {
+      size_t count = bytes.size() / sizeof(uint64_t);
+      words.assign(count, 0);
+      for (size_t plane = 0; plane < sizeof(uint64_t); ++plane)
+      {
+        const unsigned char *in = bytes.data() + plane * count;
+        for (size_t i = 0; i < count; ++i)
+          words[i] |= static_cast<uint64_t>(in[i]) << (8 * plane);
+      }
+    }
+
+    // A zero byte is followed by the length of its run (1 to 255), other bytes are
+    // copied
+    void packRuns(const std::vector<unsigned char> &bytes, std::vector<unsigned char> &packed)
+    {
+      packed.clear();
+      size_t size = bytes.size();
+      for (size_t i = 0; i < size;)
+      {
+        if (bytes[i] != 0)
+        {
+          packed.push_back(bytes[i++]);
+          continue;
+        }
+        size_t run = 1;
+        while (i + run < size && run < 255 && bytes[i + run] == 0)
+          run++;
+        packed.push_back(0);
+        packed.push_back(static_cast<unsigned char>(run));
+        i += run;
+      }
+    }
+
+    void unpackRuns(const unsigned char *packed, size_t size, std::vector<unsigned char> &bytes)
+    {
+      size_t expected = bytes.size();
+      size_t out = 0;
+      for (size_t i = 0; i < size; ++i)
+      {
+        if (packed[i] != 0)
+        {
+          if (out == expected)
+            throw std::runtime_error("TrajectoryDecoder: corrupted frame");
+          bytes[out++] = packed[i];
+          continue;
+        }
+        if (++i == size || packed[i] > expected - out)
+          throw std::runtime_error("TrajectoryDecoder: corrupted frame");
+        std::fill_n(bytes.begin() + out, packed[i], 0);
+        out += packed[i];
+      }
+      if (out != expected)
+        throw std::runtime_error("TrajectoryDecoder: corrupted frame");
+    }
+  } // namespace
+
+  TrajectoryEncoder::TrajectoryEncoder(double precision, int keyInterval)
+  {
+    setPrecision(precision, keyInterval);
+  }
+
+  void TrajectoryEncoder::setPrecision(double precision, int keyInterval)
+  {
+    if (!(precision > 0.0))
+      throw std::runtime_error("TrajectoryEncoder: the precision must be positive");
+    _precision = precision;
+    _keyInterval = std::max(1, keyInterval);
+    // The next frame starts a new group
+    _sinceKey = 0;
+  }
+
+  void TrajectoryEncoder::encode(double time, size_t count, const double *x, const double *y, const double *z,
+                                 std::vector<char> &out)
+  {
+    const double *coords[3] = {x, y, z};
+    bool key = _sinceKey == 0 || count != _order.size();
+
+    if (key)
+    {
+      double lo[3] = {0.0, 0.0, 0.0};
+      double hi[3] = {0.0, 0.0, 0.0};
+      for (int k = 0; k < 3 && count > 0; ++k)
+      {
+        auto range = std::minmax_element(coords[k], coords[k] + count);
+        lo[k] = *range.first;
+        hi[k] = *range.second;
+      }
+      double extent = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+      _step = _precision * (extent > 0.0 ? extent : 1.0);
+      std::copy(lo, lo + 3, _origin);
+
+      // Neighbours in space are neighbours in the frame, their positions and
+      // displacements are close
+      std::vector<uint64_t> keys(count);
+      for (size_t i = 0; i < count; ++i)
+        keys[i] = Functions::mortonKey({x[i], y[i], z[i]}, lo, hi);
+      _order.resize(count);
+      std::iota(_order.begin(), _order.end(), 0);
+      std::stable_sort(_order.begin(), _order.end(),
+                       [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+      _prev.assign(3 * count, 0);
+      _sinceKey = 0;
+    }
+
+    _words.resize((key ? count : 0) + 3 * count);
+    uint64_t *word = _words.data();
+    if (key)
+      word = std::copy(_order.begin(), _order.end(), word);
+
+    for (int k = 0; k < 3; ++k)
+    {
+      const double *coord = coords[k];
+      int64_t *prev = _prev.data() + k * count;
+      int64_t last = 0;
+      for (size_t j = 0; j < count; ++j)
+      {
+        int64_t q = std::llround((coord[_order[j]] - _origin[k]) / _step);
+        int64_t delta = q - prev[j];
+        prev[j] = q;
+        *word++ = zigzag(delta - last);
+        last = delta;
+      }
+    }
+
+    shuffle(_words, _shuffled);
+
+    TrajectoryFrameHeader header;
+    header.time = time;
+    header.count = count;
+    std::copy(_origin, _origin + 3, header.origin);
+    header.step = _step;
+    header.keyframe = key;
+
+#if defined(NBODY_HAVE_ZSTD)
+    header.codec = TRAJECTORY_ZSTD;
+    _packed.resize(ZSTD_compressBound(_shuffled.size()));
+    size_t packed = ZSTD_compress(_packed.data(), _packed.size(), _shuffled.data(), _shuffled.size(), 3);
+    if (ZSTD_isError(packed))
+      throw std::runtime_error(std::string("TrajectoryEncoder: ") + ZSTD_getErrorName(packed));
+    _packed.resize(packed);
+#else
+    header.codec = TRAJECTORY_RLE;
+    packRuns(_shuffled, _packed);
+#endif
+    header.bytes = _packed.size();
+
+    size_t offset = out.size();
+    out.resize(offset + sizeof(header) + _packed.size());
+    std::memcpy(out.data() + offset, &header, sizeof(header));
+    std::memcpy(out.data() + offset + sizeof(header), _packed.data(), _packed.size());
+
+    _sinceKey = (_sinceKey + 1) % _keyInterval;
+  }
+
+  bool TrajectoryDecoder::decode(const char *frame, std::vector<double> &x, std::vector<double> &y,
+                                 std::vector<double> &z)
+  {
+    TrajectoryFrameHeader header;
+    std::memcpy(&header, frame, sizeof(header));
+    size_t count = header.count;
+
+    if (!header.keyframe && (!_valid || _order.size() != count))
+      return false;
+    // Until the frame is decoded
+    _valid = false;
+
+    _shuffled.resize(((header.keyframe ? count : 0) + 3 * count) * sizeof(uint64_t));
+    const unsigned char *packed = reinterpret_cast<const unsigned char *>(frame + sizeof(header));
+
+    if (header.codec == TRAJECTORY_RLE)
+      unpackRuns(packed, header.bytes, _shuffled);
+    else if (header.codec == TRAJECTORY_ZSTD)
+    {
+#if defined(NBODY_HAVE_ZSTD)
+      size_t size = ZSTD_decompress(_shuffled.data(), _shuffled.size(), packed, header.bytes);
+      if (ZSTD_isError(size) || size != _shuffled.size())
+        throw std::runtime_error("TrajectoryDecoder: corrupted frame");
+#else
+      throw std::runtime_error("TrajectoryDecoder: the frame needs zstd, the library was built without it");
+#endif
+    }
+    else
+      throw std::runtime_error("TrajectoryDecoder: unknown codec " + std::to_string(header.codec));
+
+    unshuffle(_shuffled, _words);
+    const uint64_t *word = _words.data();
+
+    if (header.keyframe)
+    {
+      _order.assign(word, word + count);
+      word += count;
+      for (uint32_t index : _order)
+      {
+        if (index >= count)
+          throw std::runtime_error("TrajectoryDecoder: corrupted frame");
+      }
+      _prev.assign(3 * count, 0);
+    }
+
+    std::vector<double> *coords[3] = {&x, &y, &z};
+    for (int k = 0; k < 3; ++k)
+    {
+      std::vector<double> &coord = *coords[k];
+      coord.resize(count);
+      int64_t *prev = _prev.data() + k * count;
+      int64_t last = 0;
+      for (size_t j = 0; j < count; ++j)
+      {
+        last += unzigzag(*word++);
+        prev[j] += last;
+        coord[_order[j]] = header.origin[k] + prev[j] * header.step;
+      }
+    }
+
+    _valid = true;
+    return true;
+  }
+
+  TrajectoryReader::TrajectoryReader(const std::string &path) : _file(path, "TrajectoryReader")
+  {
+    if (_file.size() < sizeof(SnapshotHeader))
+      throw std::runtime_error("TrajectoryReader: " + path + " is not a trajectory");
+
+    SnapshotHeader fileHeader;
+    std::memcpy(&fileHeader, _file.data(), sizeof(fileHeader));
+    if (std::memcmp(fileHeader.magic, TRAJECTORY_MAGIC, sizeof(fileHeader.magic)) != 0 ||
+        fileHeader.version != TRAJECTORY_VERSION || fileHeader.fields != SNAPSHOT_FIELDS)
+      throw std::runtime_error("TrajectoryReader: " + path + " is not a trajectory of version " +
+                               std::to_string(TRAJECTORY_VERSION));
+
+    // A frame cut by a crash is ignored
+    size_t offset = sizeof(SnapshotHeader);
+    while (offset + sizeof(TrajectoryFrameHeader) <= _file.size())
+    {
+      TrajectoryFrameHeader frame;
+      std::memcpy(&frame, _file.data() + offset, sizeof(frame));
+      if (frame.bytes > _file.size() - offset - sizeof(TrajectoryFrameHeader))
+        break;
+
+      _frames.push_back(offset);
+      offset += sizeof(TrajectoryFrameHeader) + frame.bytes;
+    }
+  }
+
+  TrajectoryFrameHeader TrajectoryReader::header(size_t frame) const
+  {
+    // Frames follow payloads of any length, their headers aren't aligned
+    TrajectoryFrameHeader header;
+    std::memcpy(&header, _file.data() + _frames.at(frame), sizeof(header));
+    return header;
+  }
+
+  void TrajectoryReader::readFrame(size_t frame, std::vector<double> &x, std::vector<double> &y,
+                                   std::vector<double> &z)
+  {
+    // Decode from the keyframe of the group, or from the last decoded frame if it is
+    // in the same group and before this one
+    size_t first = frame;
+    while (first > 0 && !header(first).keyframe)
+      first--;
+    if (_last >= static_cast<long>(first) && _last < static_cast<long>(frame))
+      first = _last + 1;
+
+    // The decoder state is lost if a frame is corrupted
+    long last = _last;
+    _last = -1;
+    for (size_t current = first; current <= frame; ++current)
+    {
+      if (!_decoder.decode(_file.data() + _frames[current], x, y, z))
+        throw std::runtime_error("TrajectoryReader: frame " + std::to_string(current) + " has no keyframe");
+      last = current;
+    }
+    _last = last;
+  }
+} // namespace NBodyEnv
@@ -0,0 +1,276 @@
+#include "Functions/AdaptiveRKDiscretizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace NBodyEnv {
+
+    // Check if the cached first stage can be reused for the given positions
+    static bool samePositions(const std::vector<Pos> &a, const std::vector<Pos> &b)
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (a[i].xPos != b[i].xPos || a[i].yPos != b[i].yPos || a[i].zPos != b[i].zPos)
+                return false;
+        }
+
+        return true;
+    }
+
+    AdaptiveRKDiscretizer::AdaptiveRKDiscretizer(int type, double absTol, double relTol)
+        : m_absTol(absTol), m_relTol(relTol), m_minStep(0.0), m_maxStep(INFINITY),
+          m_accepted(0), m_rejected(0), m_cacheValid(false)
+    {
+        switch(type){
+            case DISC_BOGSHAMP:
+                setBogShamp();
+                break;
+            case DISC_CASHKARP:
+                setCashKarp();
+                break;
+            case DISC_DOPRI5:
+            default:
+                setDopri5();
+                break;
+        }
+    }
+
+    void AdaptiveRKDiscretizer::setTolerance(double absTol, double relTol) {
+        m_absTol = absTol;
+        m_relTol = relTol;
+    }
+
+    void AdaptiveRKDiscretizer::setStepBounds(double minStep, double maxStep) {
+        m_minStep = minStep;
+        m_maxStep = maxStep;
+    }
+
+    void AdaptiveRKDiscretizer::clear() {
+        m_a.clear();
+        m_b.clear();
+        m_bHat.clear();
+        m_c.clear();
+        m_cacheValid = false;
+    }
+
+    void AdaptiveRKDiscretizer::setBogShamp() {
+        clear();
+
+        m_a = {
+            {0.0,       0.0,       0.0,       0.0},
+            {1.0 / 2.0, 0.0,       0.0,       0.0},
+            {0.0,       3.0 / 4.0, 0.0,       0.0},
+            {2.0 / 9.0, 1.0 / 3.0, 4.0 / 9.0, 0.0}
+        };
+        m_b = {2.0 / 9.0, 1.0 / 3.0, 4.0 / 9.0, 0.0};
+        m_bHat = {7.0 / 24.0, 1.0 / 4.0, 1.0 / 3.0, 1.0 / 8.0};
+        m_c = {0.0, 1.0 / 2.0, 3.0 / 4.0, 1.0};
+        m_errOrder = 2;
+        m_fsal = true;
+    }
+
+    void AdaptiveRKDiscretizer::setCashKarp() {
+        clear();
+
+        m_a = {
+            {0.0,             0.0,         0.0,           0.0,              0.0,          0.0},
+            {1.0 / 5.0,       0.0,         0.0,           0.0,              0.0,          0.0},
+            {3.0 / 40.0,      9.0 / 40.0,  0.0,           0.0,              0.0,          0.0},
+            {3.0 / 10.0,      -9.0 / 10.0, 6.0 / 5.0,     0.0,              0.0,          0.0},
+            {-11.0 / 54.0,    5.0 / 2.0,   -70.0 / 27.0,  35.0 / 27.0,      0.0,          0.0},
+            {1631.0 / 55296.0, 175.0 / 512.0, 575.0 / 13824.0, 44275.0 / 110592.0, 253.0 / 4096.0, 0.0}
+        };
+        m_b = {37.0 / 378.0, 0.0, 250.0 / 621.0, 125.0 / 594.0, 0.0, 512.0 / 1771.0};
+        m_bHat = {2825.0 / 27648.0, 0.0, 18575.0 / 48384.0, 13525.0 / 55296.0, 277.0 / 14336.0, 1.0 / 4.0};
+        m_c = {0.0, 1.0 / 5.0, 3.0 / 10.0, 3.0 / 5.0, 1.0, 7.0 / 8.0};
+        m_errOrder = 4;
+        m_fsal = false;
+    }
+
+    void AdaptiveRKDiscretizer::setDopri5() {
+        clear();
+
+        m_a = {
+            {0.0,              0.0,               0.0,              0.0,            0.0,               0.0,         0.0},
+            {1.0 / 5.0,        0.0,               0.0,              0.0,            0.0,               0.0,         0.0},
+            {3.0 / 40.0,       9.0 / 40.0,        0.0,              0.0,            0.0,               0.0,         0.0},
+            {44.0 / 45.0,      -56.0 / 15.0,      32.0 / 9.0,       0.0,            0.0,               0.0,         0.0},
+            {19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0, 0.0,               0.0,         0.0},
+            {9017.0 / 3168.0,  -355.0 / 33.0,     46732.0 / 5247.0, 49.0 / 176.0,   -5103.0 / 18656.0, 0.0,         0.0},
+            {35.0 / 384.0,     0.0,               500.0 / 1113.0,   125.0 / 192.0,  -2187.0 / 6784.0,  11.0 / 84.0, 0.0}
+        };
+        m_b = {35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0, 0.0};
+        m_bHat = {5179.0 / 57600.0, 0.0, 7571.0 / 16695.0, 393.0 / 640.0, -92097.0 / 339200.0, 187.0 / 2100.0, 1.0 / 40.0};
+        m_c = {0.0, 1.0 / 5.0, 3.0 / 10.0, 4.0 / 5.0, 8.0 / 9.0, 1.0, 1.0};
+        m_errOrder = 4;
+        m_fsal = true;
+    }
+
+    void AdaptiveRKDiscretizer::setStage(size_t stage, const std::vector<Pos> &pos, const std::vector<Vel> &vel, double deltaTime) {
+        // The last "stage" is the propagated solution itself
+        const std::vector<double> &weights = stage < m_a.size() ? m_a[stage] : m_b;
+        size_t numStages = std::min(stage, m_b.size());
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+        for (size_t p = 0; p < pos.size(); ++p)
+        {
+            Pos tempPos = pos[p];
+            Vel tempVel = vel[p];
+
+            for (size_t j = 0; j < numStages; ++j)
+            {
+                double weight = deltaTime * weights[j];
+                if (weight == 0.0)
+                    continue;
+
+                tempPos.xPos += weight * m_kPos[j][p].xVel;
+                tempPos.yPos += weight * m_kPos[j][p].yVel;
+                tempPos.zPos += weight * m_kPos[j][p].zVel;
+
+                tempVel.xVel += weight * m_k[j][p].xAcc;
+                tempVel.yVel += weight * m_k[j][p].yAcc;
+                tempVel.zVel += weight * m_k[j][p].zAcc;
+            }
+
+            m_stagePos[p] = tempPos;
+            m_stageVel[p] = tempVel;
+        }
+    }
+
+    double AdaptiveRKDiscretizer::errorNorm(const std::vector<Pos> &pos, const std::vector<Vel> &vel, double deltaTime) {
+        double sum = 0.0;
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static) reduction(+:sum)
+#endif
+        for (size_t p = 0; p < pos.size(); ++p)
+        {
+            // Difference between the propagated and the embedded solution
+            double err[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+            for (size_t j = 0; j < m_b.size(); ++j)
+            {
+                double weight = deltaTime * (m_b[j] - m_bHat[j]);
+                if (weight == 0.0)
+                    continue;
+
+                err[0] += weight * m_kPos[j][p].xVel;
+                err[1] += weight * m_kPos[j][p].yVel;
+                err[2] += weight * m_kPos[j][p].zVel;
+                err[3] += weight * m_k[j][p].xAcc;
+                err[4] += weight * m_k[j][p].yAcc;
+                err[5] += weight * m_k[j][p].zAcc;
+            }
+
+            // Mixed absolute/relative scale on the old and new state
+            double oldState[6] = {pos[p].xPos, pos[p].yPos, pos[p].zPos, vel[p].xVel, vel[p].yVel, vel[p].zVel};
+            double newState[6] = {m_stagePos[p].xPos, m_stagePos[p].yPos, m_stagePos[p].zPos,
+                                  m_stageVel[p].xVel, m_stageVel[p].yVel, m_stageVel[p].zVel};
+
+            for (int c = 0; c < 6; ++c)
+            {
+                double scale = m_absTol + m_relTol * std::max(std::abs(oldState[c]), std::abs(newState[c]));
+                sum += (err[c] / scale) * (err[c] / scale);
+            }
+        }
+
+        return std::sqrt(sum / (6.0 * pos.size()));
+    }
+
+    double AdaptiveRKDiscretizer::step(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccFunction &accFunc,
+                                       double &deltaTime, double maxStep) {
+        // Step size controller parameters
+        constexpr double safety = 0.9;
+        constexpr double minFactor = 0.2;
+        constexpr double maxFactor = 5.0;
+        constexpr int maxRejected = 64;
+
+        size_t numStages = m_b.size();
+        double trialStep = std::min(deltaTime, m_maxStep);
+
+        m_kPos.resize(numStages);
+        m_k.resize(numStages);
+        for (size_t i = 0; i < numStages; ++i)
+        {
+            m_kPos[i].resize(pos.size());
+            m_k[i].resize(pos.size());
+        }
+        m_stagePos.resize(pos.size());
+        m_stageVel.resize(pos.size());
+
+        if (pos.empty())
+            return std::min(trialStep, maxStep);
+
+        // First stage doesn't depend on the step size, evaluate it only once. The end of the
+        // last accepted step has it already, if the positions haven't been changed since
+        if (m_cacheValid && samePositions(pos, m_cachedPos))
+        {
+            if (m_fsal)
+                std::swap(m_k[0], m_k[numStages - 1]);
+        }
+        else
+            accFunc(pos, m_k[0]);
+        m_kPos[0] = vel;
+        m_cacheValid = false;
+
+        bool rejected = false;
+        int numRejected = 0;
+
+        while (true)
+        {
+            double currStep = std::min(trialStep, maxStep);
+
+            for (size_t i = 1; i < numStages; ++i)
+            {
+                setStage(i, pos, vel, currStep);
+                m_kPos[i] = m_stageVel;
+                accFunc(m_stagePos, m_k[i]);
+            }
+
+            // Propagated solution
+            setStage(numStages, pos, vel, currStep);
+
+            double err = errorNorm(pos, vel, currStep);
+            double factor = err > 0.0 ? safety * std::pow(err, -1.0 / (m_errOrder + 1)) : maxFactor;
+            factor = std::isnan(err) ? minFactor : std::min(maxFactor, std::max(minFactor, factor));
+
+            if (err <= 1.0)
+            {
+                pos = m_stagePos;
+                vel = m_stageVel;
+
+                // Accelerations at the new state, which are also the first stage of the next
+                // step: the last stage with FSAL tables, one more evaluation otherwise
+                if (!m_fsal)
+                    accFunc(pos, m_k[0]);
+                m_cachedPos = pos;
+                m_cacheValid = true;
+
+                if (rejected)
+                    factor = std::min(factor, 1.0);
+
+                // Don't let a step shortened to hit an output time shrink the next ones
+                double nextStep = currStep * factor;
+                if (currStep < trialStep)
+                    nextStep = std::max(nextStep, trialStep);
+                deltaTime = std::min(nextStep, m_maxStep);
+
+                m_accepted++;
+                return currStep;
+            }
+
+            // Rejected, retry with a smaller step
+            m_rejected++;
+            rejected = true;
+            trialStep = currStep * factor;
+
+            if (trialStep < m_minStep || ++numRejected > maxRejected)
+                throw std::runtime_error("AdaptiveRKDiscretizer: step size underflow, cannot satisfy the tolerance");
+        }
+    }
+}
@@ -6,6 +6,31 @@
 
 namespace NBodyEnv
 {
+  void Sources::load(const std::vector<Pos> &pos, const std::vector<Vel> &vel, const std::vector<Particle> &particles)
+  {
+    size_t n = particles.size();
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    vx.resize(n);
+    vy.resize(n);
+    vz.resize(n);
+    mass.resize(n);
+    radius.resize(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      x[i] = pos[i].xPos;
+      y[i] = pos[i].yPos;
+      z[i] = pos[i].zPos;
+      vx[i] = vel[i].xVel;
+      vy[i] = vel[i].yVel;
+      vz[i] = vel[i].zVel;
+      mass[i] = particles[i].getVisible() ? particles[i].getSpecInfo() : 0.0;
+      radius[i] = particles[i].getRadius();
+    }
+  }
+
   void Functions::getGrav(Particle &p1, Particle &p2)
   {
 
@@ -75,9 +100,6 @@ namespace NBodyEnv
     // add force contributions to both particles, invert it for the second one
     p1.addForce(dummyForce);
     dummyForce.invert();
-    dummyForce.xForce = -dummyForce.xForce;
-    dummyForce.yForce = -dummyForce.yForce;
-    dummyForce.zForce = -dummyForce.zForce;
     p2.addForce(dummyForce);
   }
 
@@ -118,4 +140,120 @@ namespace NBodyEnv
     return dummyForce;
   }
 
+  Acc Functions::getGravAcc(const Pos &p1, const Pos &p2, double mTwo, double radOne, double radTwo)
+  {
+    // compute the distance between p1 and p2
+    double xDistance = p1.xPos - p2.xPos;
+    double yDistance = p1.yPos - p2.yPos;
+    double zDistance = p1.zPos - p2.zPos;
+    double distanceSquared = xDistance * xDistance + yDistance * yDistance +
+                             zDistance * zDistance;
+
+    // Detect collision between the two particles, same as getGravTwo
+    if (distanceSquared <= (radOne + radTwo) * (radOne + radTwo))
+    {
+      return {0.0, 0.0, 0.0};
+    }
+
+    double distance = sqrt(distanceSquared);
+    double k = -G * mTwo / (distanceSquared * distance);
+
+    return {k * xDistance, k * yDistance, k * zDistance};
+  }
+
+  void Functions::getGravJac(const Pos &p1, const Pos &p2, double mTwo, double radOne, double radTwo, std::array<double, 9> &jac)
+  {
+    double distance[3] = {p2.xPos - p1.xPos, p2.yPos - p1.yPos, p2.zPos - p1.zPos};
+    double distanceSquared = distance[0] * distance[0] + distance[1] * distance[1] +
+                             distance[2] * distance[2];
+
+    // No force inside the collision radius, hence no derivative
+    if (distanceSquared <= (radOne + radTwo) * (radOne + radTwo))
+    {
+      return;
+    }
+
+    // d(a)/d(p1) = G * m2 * (3 * d * d^T / r^5 - I / r^3), with d = p2 - p1
+    double invDistanceCubed = 1.0 / (distanceSquared * sqrt(distanceSquared));
+    double k = G * mTwo * invDistanceCubed;
+
+    for (int row = 0; row < 3; ++row)
+    {
+      for (int col = 0; col < 3; ++col)
+      {
+        jac[3 * row + col] += k * 3.0 * distance[row] * distance[col] / distanceSquared;
+      }
+      jac[4 * row] -= k;
+    }
+  }
+
+  void Functions::getGravAccJerk(const Pos &p1, const Vel &v1, double radius, size_t self, const Sources &sources,
+                                 Acc &acc, Jerk &jerk)
+  {
+    const double *x = sources.x.data();
+    const double *y = sources.y.data();
+    const double *z = sources.z.data();
+    const double *vx = sources.vx.data();
+    const double *vy = sources.vy.data();
+    const double *vz = sources.vz.data();
+    const double *mass = sources.mass.data();
+    const double *rad = sources.radius.data();
+
+    double ax = 0.0, ay = 0.0, az = 0.0;
+    double jx = 0.0, jy = 0.0, jz = 0.0;
+
+    // Branch free body so that the loop vectorizes: the particle itself and the
+    // collided pairs are masked out instead of skipped
+#if defined(_OPENMP)
+#pragma omp simd reduction(+:ax, ay, az, jx, jy, jz)
+#endif
+    for (size_t j = 0; j < sources.size(); ++j)
+    {
+      double dx = x[j] - p1.xPos;
+      double dy = y[j] - p1.yPos;
+      double dz = z[j] - p1.zPos;
+      double dvx = vx[j] - v1.xVel;
+      double dvy = vy[j] - v1.yVel;
+      double dvz = vz[j] - v1.zVel;
+
+      double distanceSquared = dx * dx + dy * dy + dz * dz;
+      double minDistance = radius + rad[j];
+      bool interact = j != self && distanceSquared > minDistance * minDistance;
+      double safeSquared = interact ? distanceSquared : 1.0;
+
+      double invDistance = 1.0 / sqrt(safeSquared);
+      double invDistanceSquared = invDistance * invDistance;
+      double k = interact ? G * mass[j] * invDistance * invDistanceSquared : 0.0;
+      // 3 * (r . v) / r^2
+      double rv = 3.0 * (dx * dvx + dy * dvy + dz * dvz) * invDistanceSquared;
+
+      ax += k * dx;
+      ay += k * dy;
+      az += k * dz;
+      jx += k * (dvx - rv * dx);
+      jy += k * (dvy - rv * dy);
+      jz += k * (dvz - rv * dz);
+    }
+
+    acc = {ax, ay, az};
+    jerk = {jx, jy, jz};
+  }
+
+  uint64_t Functions::mortonKey(const Pos &pos, const double lo[3], const double hi[3])
+  {
+    const double coord[3] = {pos.xPos, pos.yPos, pos.zPos};
+    uint64_t key = 0;
+
+    for (int k = 0; k < 3; ++k)
+    {
+      double extent = hi[k] > lo[k] ? hi[k] - lo[k] : 1.0;
+      uint64_t cell = static_cast<uint64_t>((coord[k] - lo[k]) / extent * ((1 << 21) - 1));
+
+      for (int bit = 0; bit < 21; ++bit)
+        key |= ((cell >> bit) & 1ULL) << (3 * bit + k);
+    }
+
+    return key;
+  }
+
 } // namespace NBodyEnv
@@ -0,0 +1,68 @@
+#include "Functions/HermiteDiscretizer.hpp"
+#include <utility>
+
+namespace NBodyEnv {
+
+    void HermiteDiscretizer::step(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccJerkFunction &accJerkFunc, double deltaTime) {
+        // Acceleration and jerk at the beginning of the step, evaluated only if the
+        // state has been changed from outside since the last step
+        bool valid = m_valid && m_lastPos.size() == pos.size();
+        for (size_t i = 0; i < pos.size() && valid; ++i) {
+            valid = m_lastPos[i].xPos == pos[i].xPos && m_lastPos[i].yPos == pos[i].yPos && m_lastPos[i].zPos == pos[i].zPos &&
+                    m_lastVel[i].xVel == vel[i].xVel && m_lastVel[i].yVel == vel[i].yVel && m_lastVel[i].zVel == vel[i].zVel;
+        }
+        if (!valid)
+            accJerkFunc(pos, vel, m_acc, m_jerk);
+
+        double dt = deltaTime;
+        double dt2 = dt * dt / 2.0;
+        double dt3 = dt * dt * dt / 6.0;
+
+        m_predPos.resize(pos.size());
+        m_predVel.resize(pos.size());
+
+        // Predictor: Taylor expansion with acceleration and jerk
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+        for (size_t i = 0; i < pos.size(); ++i) {
+            m_predPos[i] = {pos[i].xPos + vel[i].xVel * dt + m_acc[i].xAcc * dt2 + m_jerk[i].xJerk * dt3,
+                            pos[i].yPos + vel[i].yVel * dt + m_acc[i].yAcc * dt2 + m_jerk[i].yJerk * dt3,
+                            pos[i].zPos + vel[i].zVel * dt + m_acc[i].zAcc * dt2 + m_jerk[i].zJerk * dt3};
+            m_predVel[i] = {vel[i].xVel + m_acc[i].xAcc * dt + m_jerk[i].xJerk * dt2,
+                            vel[i].yVel + m_acc[i].yAcc * dt + m_jerk[i].yJerk * dt2,
+                            vel[i].zVel + m_acc[i].zAcc * dt + m_jerk[i].zJerk * dt2};
+        }
+
+        // Corrector: Hermite interpolation of the acceleration over the step
+        double dt12 = dt * dt / 12.0;
+
+        for (int corr = 0; corr < m_corrections; ++corr) {
+            accJerkFunc(m_predPos, m_predVel, m_newAcc, m_newJerk);
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+            for (size_t i = 0; i < pos.size(); ++i) {
+                Vel newVel = {vel[i].xVel + (m_acc[i].xAcc + m_newAcc[i].xAcc) * dt / 2.0 + (m_jerk[i].xJerk - m_newJerk[i].xJerk) * dt12,
+                              vel[i].yVel + (m_acc[i].yAcc + m_newAcc[i].yAcc) * dt / 2.0 + (m_jerk[i].yJerk - m_newJerk[i].yJerk) * dt12,
+                              vel[i].zVel + (m_acc[i].zAcc + m_newAcc[i].zAcc) * dt / 2.0 + (m_jerk[i].zJerk - m_newJerk[i].zJerk) * dt12};
+                m_predPos[i] = {pos[i].xPos + (vel[i].xVel + newVel.xVel) * dt / 2.0 + (m_acc[i].xAcc - m_newAcc[i].xAcc) * dt12,
+                                pos[i].yPos + (vel[i].yVel + newVel.yVel) * dt / 2.0 + (m_acc[i].yAcc - m_newAcc[i].yAcc) * dt12,
+                                pos[i].zPos + (vel[i].zVel + newVel.zVel) * dt / 2.0 + (m_acc[i].zAcc - m_newAcc[i].zAcc) * dt12};
+                m_predVel[i] = newVel;
+            }
+        }
+
+        pos = m_predPos;
+        vel = m_predVel;
+
+        // As usual for Hermite schemes, the last evaluation (at the predicted state) starts
+        // the next step, so a step costs a single evaluation
+        std::swap(m_acc, m_newAcc);
+        std::swap(m_jerk, m_newJerk);
+        m_lastPos = pos;
+        m_lastVel = vel;
+        m_valid = true;
+    }
+}
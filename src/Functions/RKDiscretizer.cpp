@@ -1,6 +1,40 @@
 #include "Functions/RKDiscretizer.hpp"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
 namespace NBodyEnv{
+    // Solve the dense system mat * x = rhs in place (rhs becomes x), Gaussian elimination
+    // with partial pivoting. Used for the small per particle Newton systems
+    static void solveDense(std::vector<double> &mat, std::vector<double> &rhs, size_t n) {
+        for (size_t col = 0; col < n; ++col) {
+            size_t pivot = col;
+            for (size_t row = col + 1; row < n; ++row) {
+                if (std::abs(mat[row * n + col]) > std::abs(mat[pivot * n + col]))
+                    pivot = row;
+            }
+
+            if (pivot != col) {
+                for (size_t k = 0; k < n; ++k)
+                    std::swap(mat[col * n + k], mat[pivot * n + k]);
+                std::swap(rhs[col], rhs[pivot]);
+            }
+
+            for (size_t row = col + 1; row < n; ++row) {
+                double factor = mat[row * n + col] / mat[col * n + col];
+                for (size_t k = col; k < n; ++k)
+                    mat[row * n + k] -= factor * mat[col * n + k];
+                rhs[row] -= factor * rhs[col];
+            }
+        }
+
+        for (size_t row = n; row-- > 0;) {
+            for (size_t k = row + 1; k < n; ++k)
+                rhs[row] -= mat[row * n + k] * rhs[k];
+            rhs[row] /= mat[row * n + row];
+        }
+    }
+
     void RKDiscretizer::clear() {
         m_a.clear();
         m_b.clear();
@@ -176,7 +210,7 @@ namespace NBodyEnv{
         m_c = {0.0, 0.4, 0.45573725, 1};
     }
 
-    void RKDiscretizer::discretize(Particle &target, Particle &particleOne, Particle &particleTwo, std::function<Force(Pos &, Pos &, double, double, double, double)> func, double deltaTime){
+    void RKDiscretizer::discretize(Particle &target, const Particle &particleOne, const Particle &particleTwo, std::function<Force(Pos &, Pos &, double, double, double, double)> func, double deltaTime){
         
         Pos tempPos;
         // Force force = {0.0, 0.0, 0.0};
@@ -190,7 +224,7 @@ namespace NBodyEnv{
         for(size_t i = 0; i < size(m_b); ++i) {
 
             // Reset tempPos value to original
-            tempPos = particleOne.getValuePos();
+            tempPos = particleOne.getPos();
 
             // Update time
             double newT = m_c[i] * deltaTime;
@@ -239,9 +273,9 @@ namespace NBodyEnv{
         target.setPos(tempPos);
     }
 
-    Vel RKDiscretizer::discretizeVel(Particle &particleOne, Particle &particleTwo, std::function<Force(Pos &, Pos &, double, double, double, double)> func, double deltaTime){
+    Vel RKDiscretizer::discretizeVel(const Particle &particleOne, const Particle &particleTwo, std::function<Force(Pos &, Pos &, double, double, double, double)> func, double deltaTime){
         Pos tempPos;
-        Pos particleTwoPos = particleTwo.getValuePos();
+        Pos particleTwoPos = particleTwo.getPos();
         Vel tempVel;
         Force force = {0.0, 0.0, 0.0};
         std::vector<Acc> k;
@@ -252,9 +286,9 @@ namespace NBodyEnv{
         for(size_t i = 0; i < size(m_b); ++i) {
 
             // Reset tempPos value to original
-            tempPos = particleOne.getValuePos();
+            tempPos = particleOne.getPos();
             // Reset tempVel value to original
-            tempVel = particleOne.getValueVel();
+            tempVel = particleOne.getVel();
 
             // Update time
             double newT = m_c[i] * deltaTime;
@@ -300,4 +334,163 @@ namespace NBodyEnv{
         // Return compute velocity contribute
         return finalVel;
     }
-}
\ No newline at end of file
+
+    bool RKDiscretizer::isImplicit() const {
+        for (size_t i = 0; i < m_a.size(); ++i) {
+            for (size_t j = i; j < m_a[i].size(); ++j) {
+                if (m_a[i][j] != 0.0)
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    void RKDiscretizer::setSolver(int solver, double tol, int maxIter) {
+        m_solver = solver;
+        m_tol = tol;
+        m_maxIter = maxIter;
+    }
+
+    void RKDiscretizer::solveImplicit(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccFunction &accFunc,
+                                      const JacFunction &jacFunc, double deltaTime) {
+        size_t numStages = m_b.size();
+        double h2 = deltaTime * deltaTime;
+
+        // Writing the stage velocities in terms of the stage accelerations, only the stage positions
+        // are unknown: X_i = x0 + c_i * h * v0 + h^2 * sum_j (A*A)_ij * a(X_j)
+        std::vector<std::vector<double>> aa(numStages, std::vector<double>(numStages, 0.0));
+        std::vector<double> c(numStages, 0.0);
+        std::vector<double> ba(numStages, 0.0);
+        double sumB = 0.0;
+
+        for (size_t i = 0; i < numStages; ++i) {
+            for (size_t j = 0; j < numStages; ++j) {
+                c[i] += m_a[i][j];
+                ba[j] += m_b[i] * m_a[i][j];
+                for (size_t k = 0; k < numStages; ++k)
+                    aa[i][j] += m_a[i][k] * m_a[k][j];
+            }
+            sumB += m_b[i];
+        }
+
+        // Initial guess: free motion
+        std::vector<std::vector<Pos>> stagePos(numStages, pos);
+        std::vector<std::vector<Acc>> stageAcc(numStages);
+
+        for (size_t i = 0; i < numStages; ++i) {
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+            for (size_t p = 0; p < pos.size(); ++p) {
+                stagePos[i][p].xPos += c[i] * deltaTime * vel[p].xVel;
+                stagePos[i][p].yPos += c[i] * deltaTime * vel[p].yVel;
+                stagePos[i][p].zPos += c[i] * deltaTime * vel[p].zVel;
+            }
+        }
+
+        // Block-diagonal Newton: per particle Jacobian of each stage, the coupling between particles
+        // is neglected, so close pairs converge about as slowly as with the fixed point iteration
+        std::vector<std::vector<std::array<double, 9>>> stageJac(numStages);
+
+        m_iterations = 0;
+        double maxDelta = INFINITY;
+
+        while (maxDelta > m_tol) {
+            if (m_iterations >= m_maxIter)
+                throw std::runtime_error("RKDiscretizer: implicit stage solver did not converge");
+
+            for (size_t i = 0; i < numStages; ++i) {
+                accFunc(stagePos[i], stageAcc[i]);
+                if (m_solver == SOLVER_NEWTON)
+                    jacFunc(stagePos[i], stageJac[i]);
+            }
+
+            m_iterations++;
+            maxDelta = 0.0;
+
+#if defined(_OPENMP)
+#pragma omp parallel reduction(max:maxDelta)
+#endif
+            {
+                size_t dim = 3 * numStages;
+                std::vector<double> mat(dim * dim);
+                std::vector<double> delta(dim);
+
+#if defined(_OPENMP)
+#pragma omp for schedule(static)
+#endif
+                for (size_t p = 0; p < pos.size(); ++p) {
+                    // Fixed point update: delta = T(X) - X
+                    for (size_t i = 0; i < numStages; ++i) {
+                        Pos target = {pos[p].xPos + c[i] * deltaTime * vel[p].xVel,
+                                      pos[p].yPos + c[i] * deltaTime * vel[p].yVel,
+                                      pos[p].zPos + c[i] * deltaTime * vel[p].zVel};
+
+                        for (size_t j = 0; j < numStages; ++j) {
+                            target.xPos += h2 * aa[i][j] * stageAcc[j][p].xAcc;
+                            target.yPos += h2 * aa[i][j] * stageAcc[j][p].yAcc;
+                            target.zPos += h2 * aa[i][j] * stageAcc[j][p].zAcc;
+                        }
+
+                        delta[3 * i] = target.xPos - stagePos[i][p].xPos;
+                        delta[3 * i + 1] = target.yPos - stagePos[i][p].yPos;
+                        delta[3 * i + 2] = target.zPos - stagePos[i][p].zPos;
+                    }
+
+                    // Newton update: solve (I - h^2 * (A*A)_ij * J(X_j)) delta = T(X) - X
+                    if (m_solver == SOLVER_NEWTON) {
+                        for (size_t i = 0; i < numStages; ++i) {
+                            for (size_t j = 0; j < numStages; ++j) {
+                                for (size_t row = 0; row < 3; ++row) {
+                                    for (size_t col = 0; col < 3; ++col) {
+                                        mat[(3 * i + row) * dim + 3 * j + col] =
+                                            (i == j && row == col ? 1.0 : 0.0) - h2 * aa[i][j] * stageJac[j][p][3 * row + col];
+                                    }
+                                }
+                            }
+                        }
+                        solveDense(mat, delta, dim);
+                    }
+
+                    for (size_t i = 0; i < numStages; ++i) {
+                        stagePos[i][p].xPos += delta[3 * i];
+                        stagePos[i][p].yPos += delta[3 * i + 1];
+                        stagePos[i][p].zPos += delta[3 * i + 2];
+
+                        double norm = std::sqrt(delta[3 * i] * delta[3 * i] + delta[3 * i + 1] * delta[3 * i + 1] +
+                                                delta[3 * i + 2] * delta[3 * i + 2]);
+                        double scale = 1.0 + std::sqrt(stagePos[i][p].xPos * stagePos[i][p].xPos +
+                                                       stagePos[i][p].yPos * stagePos[i][p].yPos +
+                                                       stagePos[i][p].zPos * stagePos[i][p].zPos);
+                        maxDelta = std::max(maxDelta, norm / scale);
+                    }
+                }
+            }
+        }
+
+        // Final update with the converged stage accelerations
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+        for (size_t p = 0; p < pos.size(); ++p) {
+            Pos newPos = {pos[p].xPos + sumB * deltaTime * vel[p].xVel,
+                          pos[p].yPos + sumB * deltaTime * vel[p].yVel,
+                          pos[p].zPos + sumB * deltaTime * vel[p].zVel};
+            Vel newVel = vel[p];
+
+            for (size_t j = 0; j < numStages; ++j) {
+                newPos.xPos += h2 * ba[j] * stageAcc[j][p].xAcc;
+                newPos.yPos += h2 * ba[j] * stageAcc[j][p].yAcc;
+                newPos.zPos += h2 * ba[j] * stageAcc[j][p].zAcc;
+
+                newVel.xVel += deltaTime * m_b[j] * stageAcc[j][p].xAcc;
+                newVel.yVel += deltaTime * m_b[j] * stageAcc[j][p].yAcc;
+                newVel.zVel += deltaTime * m_b[j] * stageAcc[j][p].zAcc;
+            }
+
+            pos[p] = newPos;
+            vel[p] = newVel;
+        }
+    }
+}
@@ -0,0 +1,157 @@
+#include "Functions/SymplecticDiscretizer.hpp"
+#include <cmath>
+
+namespace NBodyEnv {
+
+    SymplecticDiscretizer::SymplecticDiscretizer(int type) : m_accValid(false)
+    {
+        switch(type){
+            case DISC_FORESTRUTH:
+                setForestRuth();
+                break;
+            case DISC_PEFRL:
+                setPEFRL();
+                break;
+            case DISC_YOSHIDA4:
+                setYoshida4();
+                break;
+            case DISC_YOSHIDA6:
+                setYoshida6();
+                break;
+            case DISC_LEAPFROG:
+            default:
+                setLeapfrog();
+                break;
+        }
+    }
+
+    void SymplecticDiscretizer::clear() {
+        m_drift.clear();
+        m_kick.clear();
+        m_accValid = false;
+    }
+
+    void SymplecticDiscretizer::compose(const std::vector<double> &weights) {
+        clear();
+
+        // Consecutive half kicks of two leapfrog steps are merged in a single one
+        m_drift.push_back(0.0);
+        m_kick.push_back(0.0);
+        for (double weight : weights) {
+            m_kick.back() += weight / 2.0;
+            m_drift.push_back(weight);
+            m_kick.push_back(weight / 2.0);
+        }
+    }
+
+    void SymplecticDiscretizer::setLeapfrog() {
+        compose({1.0});
+        m_order = 2;
+    }
+
+    void SymplecticDiscretizer::setForestRuth() {
+        clear();
+
+        double theta = 1.0 / (2.0 - std::cbrt(2.0));
+
+        m_drift = {theta / 2.0, (1.0 - theta) / 2.0, (1.0 - theta) / 2.0, theta / 2.0};
+        m_kick = {theta, 1.0 - 2.0 * theta, theta, 0.0};
+        m_order = 4;
+    }
+
+    void SymplecticDiscretizer::setPEFRL() {
+        clear();
+
+        double xi = 0.1786178958448091;
+        double lambda = -0.2123418310626054;
+        double chi = -0.6626458266981849e-1;
+
+        m_drift = {xi, chi, 1.0 - 2.0 * (chi + xi), chi, xi};
+        m_kick = {(1.0 - 2.0 * lambda) / 2.0, lambda, lambda, (1.0 - 2.0 * lambda) / 2.0, 0.0};
+        m_order = 4;
+    }
+
+    void SymplecticDiscretizer::setYoshida4() {
+        double w1 = 1.0 / (2.0 - std::cbrt(2.0));
+        double w0 = 1.0 - 2.0 * w1;
+
+        compose({w1, w0, w1});
+        m_order = 4;
+    }
+
+    void SymplecticDiscretizer::setYoshida6() {
+        double w1 = -1.17767998417887;
+        double w2 = 0.235573213359357;
+        double w3 = 0.784513610477560;
+        double w0 = 1.0 - 2.0 * (w1 + w2 + w3);
+
+        compose({w3, w2, w1, w0, w1, w2, w3});
+        m_order = 6;
+    }
+
+    int SymplecticDiscretizer::getForceEvaluations() const {
+        int evaluations = 0;
+        for (double kick : m_kick) {
+            if (kick != 0.0)
+                evaluations++;
+        }
+
+        // Kick at the beginning of the step with the accelerations of the last one
+        if (m_drift.front() == 0.0 && m_kick.front() != 0.0 && m_kick.back() != 0.0)
+            evaluations--;
+
+        return evaluations;
+    }
+
+    void SymplecticDiscretizer::drift(std::vector<Pos> &pos, const std::vector<Vel> &vel, double deltaTime) {
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+        for (size_t i = 0; i < pos.size(); ++i) {
+            pos[i].xPos += vel[i].xVel * deltaTime;
+            pos[i].yPos += vel[i].yVel * deltaTime;
+            pos[i].zPos += vel[i].zVel * deltaTime;
+        }
+    }
+
+    void SymplecticDiscretizer::kick(std::vector<Vel> &vel, const std::vector<Acc> &acc, double deltaTime) {
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+        for (size_t i = 0; i < vel.size(); ++i) {
+            vel[i].xVel += acc[i].xAcc * deltaTime;
+            vel[i].yVel += acc[i].yAcc * deltaTime;
+            vel[i].zVel += acc[i].zAcc * deltaTime;
+        }
+    }
+
+    void SymplecticDiscretizer::step(std::vector<Pos> &pos, std::vector<Vel> &vel, const AccFunction &accFunc, double deltaTime) {
+        // The cached accelerations are valid only if nobody moved the particles in between
+        if (m_accValid && m_accPos.size() == pos.size()) {
+            for (size_t i = 0; i < pos.size() && m_accValid; ++i) {
+                m_accValid = m_accPos[i].xPos == pos[i].xPos && m_accPos[i].yPos == pos[i].yPos &&
+                             m_accPos[i].zPos == pos[i].zPos;
+            }
+        } else {
+            m_accValid = false;
+        }
+
+        for (size_t i = 0; i < m_drift.size(); ++i) {
+            if (m_drift[i] != 0.0) {
+                drift(pos, vel, m_drift[i] * deltaTime);
+                m_accValid = false;
+            }
+
+            if (m_kick[i] != 0.0) {
+                if (!m_accValid) {
+                    accFunc(pos, m_acc);
+                    m_accValid = true;
+                }
+                kick(vel, m_acc, m_kick[i] * deltaTime);
+            }
+        }
+
+        if (m_accValid)
+            m_accPos = pos;
+    }
+}
@@ -0,0 +1,392 @@
+#include "MPIEngine/MPIEngine.hpp"
+#include "Functions/Functions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+namespace NBodyEnv {
+
+    MPI_Datatype MPIEngine::contiguousType(MPI_Datatype base, int width) {
+        static std::map<std::pair<MPI_Datatype, int>, MPI_Datatype> types;
+
+        auto found = types.find({base, width});
+        if (found != types.end())
+            return found->second;
+
+        MPI_Datatype type;
+        MPI_Type_contiguous(width, base, &type);
+        MPI_Type_commit(&type);
+        types[{base, width}] = type;
+        return type;
+    }
+
+    MPIEngine::MPIEngine(const MPIEngine &other)
+        : m_engine(other.m_engine), m_floatDeltas(other.m_floatDeltas), m_changed(other.m_changed),
+          m_rank(other.m_rank), m_size(other.m_size), m_counts(other.m_counts), m_displs(other.m_displs) {}
+
+    MPIEngine &MPIEngine::operator=(const MPIEngine &other) {
+        if (this != &other) {
+            freeRing();
+            m_engine = other.m_engine;
+            m_floatDeltas = other.m_floatDeltas;
+            m_changed = other.m_changed;
+            m_rank = other.m_rank;
+            m_size = other.m_size;
+            m_counts = other.m_counts;
+            m_displs = other.m_displs;
+        }
+        return *this;
+    }
+
+    MPIEngine::~MPIEngine() {
+        freeRing();
+    }
+
+    void MPIEngine::freeRing() {
+        if (!m_ringReady)
+            return;
+        m_ringReady = false;
+
+        // Requests can't be freed once MPI is finalized, they are gone anyway
+        int finalized;
+        MPI_Finalized(&finalized);
+        if (finalized)
+            return;
+
+        for (int b = 0; b < 2; ++b) {
+            MPI_Request_free(&m_ringSend[b]);
+            MPI_Request_free(&m_ringRecv[b]);
+        }
+        MPI_Request_free(&m_homeSend);
+        MPI_Request_free(&m_homeRecv);
+    }
+
+    void MPIEngine::setupRing() {
+        // Reactions on the particles of a slice, every block is sent with the size of the largest one
+        int length = 3 * *std::max_element(m_counts.begin(), m_counts.end());
+
+        if (m_ringReady && static_cast<int>(m_home.size()) == length)
+            return;
+
+        freeRing();
+
+        for (int b = 0; b < 2; ++b)
+            m_block[b].assign(length, 0.0);
+        m_home.assign(length, 0.0);
+
+        // A single rank computes all its pairs, nothing travels
+        if (m_size == 1)
+            return;
+
+        int left = (m_rank + m_size - 1) % m_size;
+        int right = (m_rank + 1) % m_size;
+        // After the last round the block held belongs to the rank half a ring to the left
+        int rounds = m_size / 2;
+        int last = rounds % 2;
+
+        // Block b goes to the right with tag b and is filled from the left with the other tag,
+        // the last block goes home with tag 2
+        for (int b = 0; b < 2; ++b) {
+            MPI_Send_init(m_block[b].data(), length, MPI_DOUBLE, right, b, MPI_COMM_WORLD, &m_ringSend[b]);
+            MPI_Recv_init(m_block[b].data(), length, MPI_DOUBLE, left, 1 - b, MPI_COMM_WORLD, &m_ringRecv[b]);
+        }
+        MPI_Send_init(m_block[last].data(), length, MPI_DOUBLE, (m_rank + m_size - rounds) % m_size, 2,
+                      MPI_COMM_WORLD, &m_homeSend);
+        MPI_Recv_init(m_home.data(), length, MPI_DOUBLE, (m_rank + rounds) % m_size, 2, MPI_COMM_WORLD, &m_homeRecv);
+
+        m_ringReady = true;
+    }
+
+    void MPIEngine::setSlices(size_t size) {
+        MPI_Comm_size(MPI_COMM_WORLD, &m_size);
+        MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
+
+        int numParts = size / m_size;
+        int remainder = size % m_size;
+        m_counts.resize(m_size);
+        m_displs.resize(m_size);
+
+        for (int rank = 0; rank < m_size; ++rank) {
+            m_counts[rank] = numParts + (rank < remainder ? 1 : 0);
+            m_displs[rank] = rank * numParts + std::min(rank, remainder);
+        }
+    }
+
+    bool MPIEngine::syncState(std::vector<Particle> &particles) {
+        // Every rank marked the same changes, so they all agree without asking each other
+        bool changed = m_changed;
+        if (changed) {
+            broadcastState(particles);
+            m_changed = false;
+        }
+
+        if (changed || m_counts.size() != static_cast<size_t>(m_size) || getEnd() > particles.size())
+            setSlices(particles.size());
+        return changed;
+    }
+
+    void MPIEngine::broadcastState(std::vector<Particle> &particles) {
+        // Position, velocity, mass, radius and visibility of each particle in a single message
+        constexpr int fields = 9;
+
+        unsigned long size = particles.size();
+        MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+        particles.resize(size);
+
+        m_state.resize(fields * size);
+        for (size_t i = 0; i < size; ++i) {
+            const Pos &pos = particles[i].getPos();
+            const Vel &vel = particles[i].getVel();
+            double *record = m_state.data() + fields * i;
+            record[0] = pos.xPos;
+            record[1] = pos.yPos;
+            record[2] = pos.zPos;
+            record[3] = vel.xVel;
+            record[4] = vel.yVel;
+            record[5] = vel.zVel;
+            record[6] = particles[i].getSpecInfo();
+            record[7] = particles[i].getRadius();
+            record[8] = particles[i].getVisible() ? 1.0 : 0.0;
+        }
+
+        MPI_Bcast(m_state.data(), size, contiguousType(MPI_DOUBLE, fields), 0, MPI_COMM_WORLD);
+
+        for (size_t i = 0; i < size; ++i) {
+            const double *record = m_state.data() + fields * i;
+            particles[i].setPos({record[0], record[1], record[2]});
+            particles[i].setVel({record[3], record[4], record[5]});
+            particles[i].setSpecInfo(record[6]);
+            particles[i].setRadius(record[7]);
+            particles[i].setVisible(record[8] != 0.0);
+        }
+    }
+
+    void MPIEngine::gatherDoubles(double *data, int width) const {
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, data, m_counts.data(), m_displs.data(),
+                       contiguousType(MPI_DOUBLE, width), MPI_COMM_WORLD);
+    }
+
+    void MPIEngine::gatherState(std::vector<Particle> &particles, const std::vector<Particle> &previous) {
+        constexpr int fields = 6;
+        size_t begin = getBegin();
+        size_t end = getEnd();
+
+        // Masses, radii and visibility don't change in a step, only positions and velocities travel
+        if (!m_floatDeltas) {
+            m_state.resize(fields * particles.size());
+            for (size_t i = begin; i < end; ++i) {
+                const Pos &pos = particles[i].getPos();
+                const Vel &vel = particles[i].getVel();
+                double *record = m_state.data() + fields * i;
+                record[0] = pos.xPos;
+                record[1] = pos.yPos;
+                record[2] = pos.zPos;
+                record[3] = vel.xVel;
+                record[4] = vel.yVel;
+                record[5] = vel.zVel;
+            }
+
+            MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, m_state.data(), m_counts.data(), m_displs.data(),
+                           contiguousType(MPI_DOUBLE, fields), MPI_COMM_WORLD);
+
+            for (size_t i = 0; i < particles.size(); ++i) {
+                if (i >= begin && i < end)
+                    continue;
+                const double *record = m_state.data() + fields * i;
+                particles[i].setPos({record[0], record[1], record[2]});
+                particles[i].setVel({record[3], record[4], record[5]});
+            }
+            return;
+        }
+
+        // Changes over the step as floats: every rank adds them to the state it already holds.
+        // The owner applies the rounded changes too, so that all the ranks keep the same state
+        m_deltas.resize(fields * particles.size());
+        for (size_t i = begin; i < end; ++i) {
+            const Pos &pos = particles[i].getPos();
+            const Vel &vel = particles[i].getVel();
+            const Pos &oldPos = previous[i].getPos();
+            const Vel &oldVel = previous[i].getVel();
+            float *record = m_deltas.data() + fields * i;
+            record[0] = static_cast<float>(pos.xPos - oldPos.xPos);
+            record[1] = static_cast<float>(pos.yPos - oldPos.yPos);
+            record[2] = static_cast<float>(pos.zPos - oldPos.zPos);
+            record[3] = static_cast<float>(vel.xVel - oldVel.xVel);
+            record[4] = static_cast<float>(vel.yVel - oldVel.yVel);
+            record[5] = static_cast<float>(vel.zVel - oldVel.zVel);
+        }
+
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, m_deltas.data(), m_counts.data(), m_displs.data(),
+                       contiguousType(MPI_FLOAT, fields), MPI_COMM_WORLD);
+
+        for (size_t i = 0; i < particles.size(); ++i) {
+            const Pos &oldPos = previous[i].getPos();
+            const Vel &oldVel = previous[i].getVel();
+            const float *record = m_deltas.data() + fields * i;
+            particles[i].setPos({oldPos.xPos + record[0], oldPos.yPos + record[1], oldPos.zPos + record[2]});
+            particles[i].setVel({oldVel.xVel + record[3], oldVel.yVel + record[4], oldVel.zVel + record[5]});
+        }
+    }
+
+    void MPIEngine::blockAcc(const std::vector<Particle> &particles, const std::vector<Pos> &pos, std::vector<Acc> &acc,
+                             int first, int count, double *reaction) {
+        constexpr int fields = 3;
+        int begin = getBegin();
+        int end = getEnd();
+
+#if defined(_OPENMP)
+        int threads = omp_get_max_threads();
+#else
+        int threads = 1;
+#endif
+        if (reaction)
+            m_partial.assign(static_cast<size_t>(threads) * fields * count, 0.0);
+
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+        {
+#if defined(_OPENMP)
+            int thread = omp_get_thread_num();
+#else
+            int thread = 0;
+#endif
+            double *partial = reaction ? m_partial.data() + static_cast<size_t>(thread) * fields * count : nullptr;
+
+#if defined(_OPENMP)
+#pragma omp for schedule(static)
+#endif
+            for (int i = begin; i < end; ++i) {
+                // absorbed particles neither move nor attract
+                if (!particles[i].getVisible())
+                    continue;
+
+                const Pos target = pos[i];
+                double radius = particles[i].getRadius();
+                double mass = particles[i].getSpecInfo();
+                Acc sum = {0.0, 0.0, 0.0};
+                for (int j = 0; j < count; ++j) {
+                    int source = first + j;
+                    if (source == i || !particles[source].getVisible())
+                        continue;
+
+                    double dx = pos[source].xPos - target.xPos;
+                    double dy = pos[source].yPos - target.yPos;
+                    double dz = pos[source].zPos - target.zPos;
+                    double distanceSquared = dx * dx + dy * dy + dz * dz;
+
+                    // No force inside the collision radius, same as getGravAcc
+                    double reach = radius + particles[source].getRadius();
+                    if (distanceSquared <= reach * reach)
+                        continue;
+
+                    double k = G / (distanceSquared * std::sqrt(distanceSquared));
+                    double toTarget = k * particles[source].getSpecInfo();
+                    sum.xAcc += toTarget * dx;
+                    sum.yAcc += toTarget * dy;
+                    sum.zAcc += toTarget * dz;
+
+                    if (partial) {
+                        double toSource = k * mass;
+                        partial[fields * j] -= toSource * dx;
+                        partial[fields * j + 1] -= toSource * dy;
+                        partial[fields * j + 2] -= toSource * dz;
+                    }
+                }
+
+                acc[i].xAcc += sum.xAcc;
+                acc[i].yAcc += sum.yAcc;
+                acc[i].zAcc += sum.zAcc;
+            }
+        }
+
+        if (!reaction)
+            return;
+
+        // Sum of the threads, in a fixed order so that the result doesn't depend on the schedule
+        for (int k = 0; k < fields * count; ++k) {
+            double sum = 0.0;
+            for (int thread = 0; thread < threads; ++thread)
+                sum += m_partial[static_cast<size_t>(thread) * fields * count + k];
+            reaction[k] = sum;
+        }
+    }
+
+    void MPIEngine::ringAcc(const std::vector<Particle> &particles, const std::vector<Pos> &pos, std::vector<Acc> &acc) {
+        // Positions, masses and radii are replicated on every rank, only the reactions travel.
+        // With P ranks rank r computes the pairs of its slice with the slices r - 1, ..., r - P / 2:
+        // the block of reactions of slice r - s arrives from the left at round s, takes the pairs of
+        // this rank and goes right, after P / 2 rounds it is sent back to its owner
+        constexpr int fields = 3;
+
+        setupRing();
+        acc.resize(particles.size());
+
+        int begin = getBegin();
+        int count = m_counts[m_rank];
+        int rounds = m_size / 2;
+
+        if (rounds > 0)
+            MPI_Start(&m_homeRecv);
+
+        for (int i = begin; i < begin + count; ++i)
+            acc[i] = {0.0, 0.0, 0.0};
+        blockAcc(particles, pos, acc, begin, count, nullptr);
+
+        bool sending[2] = {false, false};
+        for (int round = 1; round <= rounds; ++round) {
+            int owner = (m_rank + m_size - round) % m_size;
+            int current = round % 2;
+            int size = fields * m_counts[owner];
+
+            // The block arrives while the pairs are computed, the first one starts here
+            bool incoming = round > 1;
+            if (incoming) {
+                if (sending[current]) {
+                    MPI_Wait(&m_ringSend[current], MPI_STATUS_IGNORE);
+                    sending[current] = false;
+                }
+                MPI_Start(&m_ringRecv[current]);
+            }
+
+            // With an even number of ranks the slices half a ring apart meet twice, the upper rank
+            // of each pair computes them and the lower one only forwards the block
+            m_reaction.assign(size, 0.0);
+            if (2 * round != m_size || m_rank >= round)
+                blockAcc(particles, pos, acc, m_displs[owner], m_counts[owner], m_reaction.data());
+
+            double *block = m_block[current].data();
+            if (incoming) {
+                MPI_Wait(&m_ringRecv[current], MPI_STATUS_IGNORE);
+                for (int k = 0; k < size; ++k)
+                    block[k] += m_reaction[k];
+            } else
+                std::copy(m_reaction.begin(), m_reaction.end(), block);
+
+            if (round < rounds) {
+                MPI_Start(&m_ringSend[current]);
+                sending[current] = true;
+            } else
+                MPI_Start(&m_homeSend);
+        }
+
+        if (rounds == 0)
+            return;
+
+        for (int b = 0; b < 2; ++b)
+            if (sending[b])
+                MPI_Wait(&m_ringSend[b], MPI_STATUS_IGNORE);
+        MPI_Wait(&m_homeSend, MPI_STATUS_IGNORE);
+        MPI_Wait(&m_homeRecv, MPI_STATUS_IGNORE);
+
+        // Reactions of the pairs computed by the other ranks
+        for (int j = 0; j < count; ++j) {
+            acc[begin + j].xAcc += m_home[fields * j];
+            acc[begin + j].yAcc += m_home[fields * j + 1];
+            acc[begin + j].zAcc += m_home[fields * j + 2];
+        }
+    }
+}
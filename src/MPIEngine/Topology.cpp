@@ -0,0 +1,173 @@
+#include "MPIEngine/Topology.hpp"
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace NBodyEnv {
+
+    std::vector<int> Topology::parseList(const std::string &path) {
+        std::vector<int> list;
+        std::ifstream file(path);
+        std::string range;
+
+        while (std::getline(file, range, ',')) {
+            std::istringstream stream(range);
+            int first, last;
+            char dash;
+            if (!(stream >> first))
+                continue;
+            last = first;
+            if (!(stream >> dash >> last) || dash != '-')
+                last = first;
+            for (int id = first; id <= last; ++id)
+                list.push_back(id);
+        }
+
+        return list;
+    }
+
+    Topology::Topology() {
+        const std::string nodes = "/sys/devices/system/node/";
+        const std::string cpus = "/sys/devices/system/cpu/";
+
+        std::vector<int> online = parseList(cpus + "online");
+        if (online.empty()) {
+            for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+                online.push_back(cpu);
+        }
+
+        for (int node : parseList(nodes + "online")) {
+            std::vector<int> nodeCpus;
+            for (int cpu : parseList(nodes + "node" + std::to_string(node) + "/cpulist")) {
+                if (std::binary_search(online.begin(), online.end(), cpu))
+                    nodeCpus.push_back(cpu);
+            }
+            // memory only nodes
+            if (!nodeCpus.empty())
+                m_nodeCpus.push_back(nodeCpus);
+        }
+        if (m_nodeCpus.empty())
+            m_nodeCpus.push_back(online);
+
+        std::set<int> packages;
+        for (int cpu : online) {
+            std::ifstream file(cpus + "cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+            int package;
+            if (file >> package)
+                packages.insert(package);
+        }
+        m_sockets = std::max<int>(1, packages.size());
+
+        m_rankCpus = online;
+    }
+
+    int Topology::getCpus() const {
+        int count = 0;
+        for (const std::vector<int> &cpus : m_nodeCpus)
+            count += cpus.size();
+        return count;
+    }
+
+    void Topology::pinThread(int cpu) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+#endif
+    }
+
+    int Topology::configure(int threads, bool pin) {
+        // Ranks running on this machine
+        MPI_Comm local;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &local);
+        int localRank;
+        MPI_Comm_rank(local, &localRank);
+        MPI_Comm_size(local, &m_localRanks);
+
+        // Cpus any of the local ranks may run on: mpirun may have bound each rank to a
+        // part of the machine, the ranks share out the union of their bindings
+        int maxCpu = 0;
+        for (const std::vector<int> &cpus : m_nodeCpus)
+            maxCpu = std::max(maxCpu, cpus.back());
+        std::vector<int> allowed(maxCpu + 1, 1);
+#if defined(__linux__)
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu <= maxCpu; ++cpu)
+                allowed[cpu] = cpu < CPU_SETSIZE && CPU_ISSET(cpu, &set);
+        }
+#endif
+        MPI_Allreduce(MPI_IN_PLACE, allowed.data(), allowed.size(), MPI_INT, MPI_MAX, local);
+        MPI_Comm_free(&local);
+
+        std::vector<std::vector<int>> nodeCpus;
+        for (const std::vector<int> &cpus : m_nodeCpus) {
+            std::vector<int> usable;
+            for (int cpu : cpus) {
+                if (allowed[cpu])
+                    usable.push_back(cpu);
+            }
+            if (!usable.empty())
+                nodeCpus.push_back(usable);
+        }
+
+        // Consecutive ranks fill a NUMA node before moving to the next one. With fewer ranks
+        // than nodes a rank spans several of them, otherwise a node is split among its ranks
+        int nodes = nodeCpus.size();
+        m_node = localRank * nodes / m_localRanks;
+        m_rankCpus.clear();
+        if (m_localRanks <= nodes) {
+            int last = (localRank + 1) * nodes / m_localRanks;
+            for (int node = m_node; node < last; ++node)
+                m_rankCpus.insert(m_rankCpus.end(), nodeCpus[node].begin(), nodeCpus[node].end());
+        } else {
+            int first = localRank;
+            while (first > 0 && (first - 1) * nodes / m_localRanks == m_node)
+                first--;
+            int count = 0;
+            while ((first + count) * nodes / m_localRanks == m_node && first + count < m_localRanks)
+                count++;
+
+            const std::vector<int> &cpus = nodeCpus[m_node];
+            int index = localRank - first;
+            m_rankCpus.assign(cpus.begin() + index * cpus.size() / count, cpus.begin() + (index + 1) * cpus.size() / count);
+            // more ranks than cpus on the node
+            if (m_rankCpus.empty())
+                m_rankCpus.push_back(cpus[index % cpus.size()]);
+        }
+
+        int cpus = m_rankCpus.size();
+        threads = threads > 0 ? std::min(threads, cpus) : cpus;
+
+#if defined(_OPENMP)
+        omp_set_num_threads(threads);
+#endif
+
+        if (!pin)
+            return threads;
+
+        // One thread per cpu, spread over the cpus of the rank if there are fewer threads
+#if defined(_OPENMP)
+#pragma omp parallel num_threads(threads)
+        {
+            int thread = omp_get_thread_num();
+            pinThread(m_rankCpus[thread * cpus / threads]);
+        }
+#else
+        pinThread(m_rankCpus.front());
+#endif
+
+        return threads;
+    }
+}
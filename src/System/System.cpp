@@ -3,140 +3,476 @@
 #include "Functions/EulerDiscretizer.hpp"
 #include "Functions/VerletDiscretizer.hpp"
 #include "TreeNode/TreeNode.hpp"
+#include <algorithm>
 #include <omp.h>
 
 namespace NBodyEnv
 {
 
-  // TODO FIX TEMPLATE
+  // Force engines shared by all the discretizers that advance the whole state at once
 
-  template <>
-  void System<EulerDiscretizer>::addParticle(Particle particle)
+  template <class T>
+  void System<T>::loadState(std::vector<Pos> &pos, std::vector<Vel> &vel) const
   {
-    _systemParticles.push_back(particle);
-    _prevState.push_back(particle);
-  }
+    pos.resize(_systemParticles.size());
+    vel.resize(_systemParticles.size());
 
-  template <>
-  const Particle &System<EulerDiscretizer>::getParticle(int index) const
-  {
-    return _systemParticles[index];
+    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    {
+      pos[i] = _systemParticles[i].getPos();
+      vel[i] = _systemParticles[i].getVel();
+    }
   }
 
-  template <>
-  void System<EulerDiscretizer>::printParticles() const
+  template <class T>
+  void System<T>::storeState(const std::vector<Pos> &pos, const std::vector<Vel> &vel)
   {
-    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end(); iter++)
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
     {
-      std::cout << "Particle number " << iter.base() << " in the system" << std::endl;
+      _systemParticles[i].setPos(pos[i]);
+      _systemParticles[i].setVel(vel[i]);
     }
   }
 
-  template <>
-  void System<EulerDiscretizer>::compute()
+  template <class T>
+  void System<T>::directAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc, bool parallel,
+                            long unsigned int begin, long unsigned int end) const
   {
-    // Save current state in a temp vector
-    std::vector<NBodyEnv::Particle> tempState(_systemParticles);
+    acc.resize(_systemParticles.size());
+    end = std::min(end, _systemParticles.size());
 
 #if defined(_OPENMP)
-#pragma omp parallel for
+#pragma omp parallel for schedule(static) if(parallel)
 #endif
-    // Reset forces
-    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
-         iter++)
+    for (long unsigned int i = begin; i < end; ++i)
     {
-      iter->setForce({0.0, 0.0, 0.0});
+      Acc sum = {0.0, 0.0, 0.0};
+
+      // absorbed particles don't move and don't attract
+      if (_systemParticles[i].getVisible())
+      {
+        for (long unsigned int j = 0; j < _systemParticles.size(); ++j)
+        {
+          if (!_systemParticles[j].getVisible() || j == i)
+            continue;
+
+          Acc contrib = Functions::getGravAcc(pos[i], pos[j], _systemParticles[j].getSpecInfo(),
+                                              _systemParticles[i].getRadius(), _systemParticles[j].getRadius());
+          sum.xAcc += contrib.xAcc;
+          sum.yAcc += contrib.yAcc;
+          sum.zAcc += contrib.zAcc;
+        }
+      }
+
+      acc[i] = sum;
     }
+  }
 
-    // boolean flag to make sure particle is updated in case all others have been absorbed
-    bool updated = false;
+  template <class T>
+  bool System<T>::isStockGrav() const
+  {
+    using GravPtr = void (*)(Particle &, Particle &);
+    const GravPtr *target = _func.template target<GravPtr>();
+    return target && *target == &Functions::getGrav;
+  }
 
-#if defined(_OPENMP)
-#pragma omp parallel for private(updated) schedule(static) /*collapse(2)*/
-#endif
+  template <class T>
+  Force System<T>::rowForce(long unsigned int i, const std::vector<Particle> &state, bool stockGrav) const
+  {
+    if (stockGrav)
+    {
+      // Same arithmetic as Functions::getGrav, without the atomic updates of the particle
+      const Pos &posOne = state[i].getPos();
+      double mOne = state[i].getSpecInfo();
+      double radOne = state[i].getRadius();
+      double xForce = 0.0, yForce = 0.0, zForce = 0.0;
+
+      for (long unsigned int j = 0; j < state.size(); ++j)
+      {
+        if (j == i || !state[j].getVisible())
+          continue;
+
+        double xDistance = posOne.xPos - state[j].getPos().xPos;
+        double yDistance = posOne.yPos - state[j].getPos().yPos;
+        double zDistance = posOne.zPos - state[j].getPos().zPos;
+        double distance = sqrt(xDistance * xDistance + yDistance * yDistance +
+                               zDistance * zDistance);
+
+        // collided particles don't interact
+        if (distance <= radOne + state[j].getRadius())
+          continue;
+
+        double totMass = mOne * state[j].getSpecInfo();
+        double k = -G * totMass / (distance * distance * distance);
+        xForce += k * xDistance;
+        yForce += k * yDistance;
+        zForce += k * zDistance;
+      }
+
+      return {xForce, yForce, zForce};
+    }
+
+    Particle row = state[i];
+    row.setForce({0.0, 0.0, 0.0});
+
+    for (long unsigned int j = 0; j < state.size(); ++j)
+    {
+      if (j == i || !state[j].getVisible())
+        continue;
+      Particle source = state[j];
+      row.computeForce(source, _func);
+    }
+
+    return row.getForce();
+  }
+
+  template <class T>
+  Force System<T>::treeForce(const Particle &particle) const
+  {
+    std::vector<double> acc = m_root.ComputeForce(particle);
+    double mass = particle.getSpecInfo();
+    return {acc[0] * mass, acc[1] * mass, acc[2] * mass};
+  }
+
+  template <class T>
+  void System<T>::bhmpiAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc)
+  {
+    int world_size;
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    int world_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+    acc.assign(_systemParticles.size(), {0.0, 0.0, 0.0});
+    if (_bhCost.size() != _systemParticles.size())
+      _bhCost.assign(_systemParticles.size(), 1.0);
+
+    // The state is the same on all the ranks, so every rank finds the same decomposition
+    std::vector<long unsigned int> order;
+    double lo[3] = {INFINITY, INFINITY, INFINITY};
+    double hi[3] = {-INFINITY, -INFINITY, -INFINITY};
     for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
     {
       if (!_systemParticles[i].getVisible())
         continue;
-      updated = false;
+      order.push_back(i);
+      const double coord[3] = {pos[i].xPos, pos[i].yPos, pos[i].zPos};
+      for (int k = 0; k < 3; ++k)
+      {
+        lo[k] = std::min(lo[k], coord[k]);
+        hi[k] = std::max(hi[k], coord[k]);
+      }
+    }
 
-      for (long unsigned int j = 0; j < _systemParticles.size(); ++j)
+    if (order.empty())
+      return;
+
+    std::vector<uint64_t> keys(_systemParticles.size(), 0);
+    for (long unsigned int i : order)
+      keys[i] = Functions::mortonKey(pos[i], lo, hi);
+    std::sort(order.begin(), order.end(), [&keys](long unsigned int a, long unsigned int b)
+              { return keys[a] != keys[b] ? keys[a] < keys[b] : a < b; });
+
+    // Contiguous ranges of keys with the same cost
+    double totalCost = 0.0;
+    for (long unsigned int i : order)
+      totalCost += _bhCost[i];
+
+    std::vector<int> first(world_size + 1, order.size());
+    double prefix = 0.0;
+    int rank = 0;
+    first[0] = 0;
+    for (long unsigned int k = 0; k < order.size(); ++k)
+    {
+      int owner = std::min(world_size - 1, static_cast<int>(prefix / totalCost * world_size));
+      while (rank < owner)
+        first[++rank] = k;
+      prefix += _bhCost[order[k]];
+    }
+
+    std::vector<int> counts(world_size);
+    for (int r = 0; r < world_size; ++r)
+      counts[r] = first[r + 1] - first[r];
+
+    // Bounding box of the particles of each rank
+    std::vector<std::vector<double>> boxMax(world_size, {-INFINITY, -INFINITY, -INFINITY});
+    std::vector<std::vector<double>> boxMin(world_size, {INFINITY, INFINITY, INFINITY});
+    for (int r = 0; r < world_size; ++r)
+    {
+      for (int k = first[r]; k < first[r + 1]; ++k)
       {
-        if (!_systemParticles[j].getVisible())
+        const Pos &p = pos[order[k]];
+        boxMax[r] = {std::max(boxMax[r][0], p.xPos), std::max(boxMax[r][1], p.yPos), std::max(boxMax[r][2], p.zPos)};
+        boxMin[r] = {std::min(boxMin[r][0], p.xPos), std::min(boxMin[r][1], p.yPos), std::min(boxMin[r][2], p.zPos)};
+      }
+    }
+
+    // Local tree
+    m_root.ResetNode(m_root.GetMax(), m_root.GetMin());
+    for (int k = first[world_rank]; k < first[world_rank + 1]; ++k)
+    {
+      Particle moved = _systemParticles[order[k]];
+      moved.setPos(pos[order[k]]);
+      m_root.InsertParticle(moved, 0);
+    }
+    if (counts[world_rank] > 0)
+      m_root.ComputeMass();
+
+    // Send to every rank the part of the local tree it needs
+    std::vector<double> sendBuf;
+    std::vector<int> sendCounts(world_size, 0);
+    std::vector<int> sendDispls(world_size, 0);
+    for (int r = 0; r < world_size; ++r)
+    {
+      sendDispls[r] = sendBuf.size();
+      if (r != world_rank && counts[world_rank] > 0 && counts[r] > 0)
+        m_root.ExportEssential(boxMax[r], boxMin[r], sendBuf);
+      sendCounts[r] = sendBuf.size() - sendDispls[r];
+    }
+
+    std::vector<int> recvCounts(world_size);
+    std::vector<int> recvDispls(world_size, 0);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int r = 1; r < world_size; ++r)
+      recvDispls[r] = recvDispls[r - 1] + recvCounts[r - 1];
+    std::vector<double> essential(recvDispls[world_size - 1] + recvCounts[world_size - 1]);
+    MPI_Alltoallv(sendBuf.data(), sendCounts.data(), sendDispls.data(), MPI_DOUBLE,
+                  essential.data(), recvCounts.data(), recvDispls.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+
+    // Own particles: local tree plus the pseudo-particles of the other ranks
+    std::vector<Acc> sorted(order.size());
+    double start = MPI_Wtime();
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (int k = first[world_rank]; k < first[world_rank + 1]; ++k)
+    {
+      Particle moved = _systemParticles[order[k]];
+      moved.setPos(pos[order[k]]);
+      std::vector<double> treeAcc = m_root.ComputeForce(moved);
+      Acc sum = {treeAcc[0], treeAcc[1], treeAcc[2]};
+
+      for (long unsigned int e = 0; e < essential.size(); e += TreeNode::essentialFields)
+      {
+        double dx = essential[e] - moved.getPos().xPos;
+        double dy = essential[e + 1] - moved.getPos().yPos;
+        double dz = essential[e + 2] - moved.getPos().zPos;
+        double r2 = dx * dx + dy * dy + dz * dz;
+        // No force inside the collision radius, as in the local tree and getGravAcc
+        double reach = moved.getRadius() + essential[e + 4];
+        if (r2 <= reach * reach || r2 == 0.0)
           continue;
-        _systemParticles[i].computeForce(_systemParticles[j], _func);
-        updated = true;
+        double r = sqrt(r2);
+        double k3 = G * essential[e + 3] / (r * r * r);
+        sum.xAcc += k3 * dx;
+        sum.yAcc += k3 * dy;
+        sum.zAcc += k3 * dz;
       }
 
-      if (!updated)
+      sorted[k] = sum;
+    }
+
+    double elapsed = MPI_Wtime() - start;
+
+    // Share the accelerations in key order
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, sorted.data(), counts.data(), first.data(),
+                   MPIEngine::contiguousType(MPI_DOUBLE, 3), MPI_COMM_WORLD);
+
+    for (long unsigned int k = 0; k < order.size(); ++k)
+      acc[order[k]] = sorted[k];
+
+    // Rebalance: the time of each rank is spread on its particles for the next decomposition
+    std::vector<double> times(world_size);
+    MPI_Allgather(&elapsed, 1, MPI_DOUBLE, times.data(), 1, MPI_DOUBLE, MPI_COMM_WORLD);
+    for (int r = 0; r < world_size; ++r)
+    {
+      double perParticle = std::max(times[r], 1.0e-9) / std::max(counts[r], 1);
+      for (int k = first[r]; k < first[r + 1]; ++k)
+        _bhCost[order[k]] = perParticle;
+    }
+  }
+
+  template <class T>
+  void System<T>::mpiAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc)
+  {
+    if (_mpi.getEngine() == MPIENGINE_RING)
+      _mpi.ringAcc(_systemParticles, pos, acc);
+    else
+      directAcc(pos, acc, true, _mpi.getBegin(), _mpi.getEnd());
+
+    _mpi.gather(acc);
+  }
+
+  template <class T>
+  void System<T>::directAccJerk(const std::vector<Pos> &pos, const std::vector<Vel> &vel, std::vector<Acc> &acc,
+                                std::vector<Jerk> &jerk, bool parallel, long unsigned int begin,
+                                long unsigned int end) const
+  {
+    acc.resize(_systemParticles.size());
+    jerk.resize(_systemParticles.size());
+    end = std::min(end, _systemParticles.size());
+
+    Sources sources;
+    sources.load(pos, vel, _systemParticles);
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static) if(parallel)
+#endif
+    for (long unsigned int i = begin; i < end; ++i)
+    {
+      // absorbed particles don't move
+      if (!_systemParticles[i].getVisible())
       {
-        // all particles have been absorbed by p1, therefore they are not visible ==> the computeForce method in the loop
-        // above has not been called, and the force on p1 has not been updated ==> we need to update it here with a ghostParticle
-        NBodyEnv::Particle ghostParticle(NBodyEnv::gravitational, {0.0, 0.0, 0.0},
-                                         {0.0, 0.0, 0.0}, 0, 0);
-        _systemParticles[i].computeForce(ghostParticle, _func);
-        // should use a break here, but it's not possible in openmp
+        acc[i] = {0.0, 0.0, 0.0};
+        jerk[i] = {0.0, 0.0, 0.0};
         continue;
       }
+
+      Functions::getGravAccJerk(pos[i], vel[i], _systemParticles[i].getRadius(), i, sources, acc[i], jerk[i]);
+    }
+  }
+
+  template <class T>
+  void System<T>::mpiAccJerk(const std::vector<Pos> &pos, const std::vector<Vel> &vel, std::vector<Acc> &acc,
+                             std::vector<Jerk> &jerk) const
+  {
+    directAccJerk(pos, vel, acc, jerk, true, _mpi.getBegin(), _mpi.getEnd());
+
+    _mpi.gather(acc);
+    _mpi.gather(jerk);
+  }
+
+  template <class T>
+  void System<T>::finishStep(std::vector<Particle> &)
+  {
+  }
+
+  template <class T>
+  void System<T>::stepParticles(bool distributed)
+  {
+    long unsigned int begin = 0;
+    long unsigned int end = _systemParticles.size();
+
+    if (distributed)
+    {
+      // ranks that started from different particles take the ones of rank 0,
+      // together with the previous state of Verlet
+      if (_mpi.syncState(_systemParticles))
+        _mpi.broadcastState(_prevState);
+      begin = _mpi.getBegin();
+      end = _mpi.getEnd();
     }
 
+    // Snapshot of the state at the beginning of the step: forces are computed on it,
+    // so each particle can be moved as soon as its own force is done
+    _snapshot = _systemParticles;
+    bool stockGrav = isStockGrav();
+
+    // Single sweep: the force of each row is accumulated locally, then the particle is updated
 #if defined(_OPENMP)
-#pragma omp parallel for
+#pragma omp parallel for schedule(static)
 #endif
-    // need to decouple the update of the position and velocity from the
-    // computation of the forces, for unknown reasons
-    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    for (long unsigned int i = begin; i < end; ++i)
     {
-      _discretizer.discretize(_systemParticles[i], _deltaTime);
+      updateParticle(i, _snapshot, stockGrav);
     }
+
+    // Every rank gets the updated slices of the others
+    if (distributed)
+      _mpi.gatherState(_systemParticles, _snapshot);
+
+    finishStep(_snapshot);
+
+    _time += _deltaTime;
   }
 
+  template <class T>
+  void System<T>::directJac(const std::vector<Pos> &pos, std::vector<std::array<double, 9>> &jac,
+                            long unsigned int begin, long unsigned int end) const
+  {
+    jac.resize(_systemParticles.size());
+    end = std::min(end, _systemParticles.size());
 
-  template <>
-  void System<EulerDiscretizer>::computeSerial()
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (long unsigned int i = begin; i < end; ++i)
+    {
+      jac[i].fill(0.0);
+
+      if (!_systemParticles[i].getVisible())
+        continue;
+
+      for (long unsigned int j = 0; j < _systemParticles.size(); ++j)
+      {
+        if (!_systemParticles[j].getVisible() || j == i)
+          continue;
+
+        Functions::getGravJac(pos[i], pos[j], _systemParticles[j].getSpecInfo(),
+                              _systemParticles[i].getRadius(), _systemParticles[j].getRadius(), jac[i]);
+      }
+    }
+  }
+
+  template <class T>
+  void System<T>::treeAcc(const std::vector<Pos> &pos, std::vector<Acc> &acc)
   {
-    // Save current state in a temp vector
-    std::vector<NBodyEnv::Particle> tempState(_systemParticles);
+    acc.assign(_systemParticles.size(), {0.0, 0.0, 0.0});
 
-    // Reset forces
-    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
-         iter++)
+    // Build the tree on the requested positions
+    m_root.ResetNode(m_root.GetMax(), m_root.GetMin());
+
+    bool empty = true;
+    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
     {
-      iter->setForce({0.0, 0.0, 0.0});
+      if (!_systemParticles[i].getVisible())
+        continue;
+      Particle moved = _systemParticles[i];
+      moved.setPos(pos[i]);
+      m_root.InsertParticle(moved, 0);
+      empty = false;
     }
 
-        for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
-        {
-          for (long unsigned int j = i + 1; j < _systemParticles.size(); ++j)
-          {
-            _systemParticles[i].computeForce(_systemParticles[j], _func);
-          }
-        }
+    if (empty)
+      return;
+
+    m_root.ComputeMass();
 
-    // need to decouple the update of the position and velocity from the
-    // computation of the forces, for unknown reasons
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
     for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
     {
-      _discretizer.discretize(_systemParticles[i], _deltaTime);
+      if (!_systemParticles[i].getVisible())
+        continue;
+      Particle moved = _systemParticles[i];
+      moved.setPos(pos[i]);
+      std::vector<double> treeAcc = m_root.ComputeForce(moved);
+      acc[i] = {treeAcc[0], treeAcc[1], treeAcc[2]};
     }
   }
 
+  // TODO FIX TEMPLATE
 
   template <>
-  void System<VerletDiscretizer>::addParticle(Particle particle)
+  void System<EulerDiscretizer>::addParticle(Particle particle)
   {
     _systemParticles.push_back(particle);
     _prevState.push_back(particle);
+    _mpi.markChanged();
   }
 
   template <>
-  const Particle &System<VerletDiscretizer>::getParticle(int index) const
+  const Particle &System<EulerDiscretizer>::getParticle(int index) const
   {
     return _systemParticles[index];
   }
 
   template <>
-  void System<VerletDiscretizer>::printParticles() const
+  void System<EulerDiscretizer>::printParticles() const
   {
     for (auto iter = _systemParticles.begin(); iter != _systemParticles.end(); iter++)
     {
@@ -145,16 +481,32 @@ namespace NBodyEnv
   }
 
   template <>
-  void System<VerletDiscretizer>::compute()
+  void System<EulerDiscretizer>::updateParticle(long unsigned int i, const std::vector<Particle> &state, bool stockGrav)
   {
-    // set number of threads
-    // omp_set_num_threads(2);
+    if (_systemParticles[i].getVisible())
+      _systemParticles[i].setForce(rowForce(i, state, stockGrav));
+    else
+      _systemParticles[i].setForce({0.0, 0.0, 0.0});
 
-    // Save current state in a temp vector
-    std::vector<NBodyEnv::Particle> tempState(_systemParticles);
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
+    _discretizer.discretize(_systemParticles[i], _deltaTime);
+  }
+
+  template <>
+  void System<EulerDiscretizer>::compute()
+  {
+    stepParticles(false);
+  }
+
+  template <>
+  void System<EulerDiscretizer>::computeMPI()
+  {
+    stepParticles(true);
+  }
+
+
+  template <>
+  void System<EulerDiscretizer>::computeSerial()
+  {
     // Reset forces
     for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
          iter++)
@@ -162,66 +514,88 @@ namespace NBodyEnv
       iter->setForce({0.0, 0.0, 0.0});
     }
 
-    // boolean flag to make sure particle is updated in case all others have been absorbed
-    bool updated = false;
-
-#if defined(_OPENMP)
-#pragma omp parallel for private(updated) schedule(static)
-#endif
+    // Each pair is visited once, so the force on particle i is complete at the end of
+    // its row and i is never read again: it can be moved right away
     for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
     {
-      if (!_systemParticles[i].getVisible())
-        continue;
-      updated = false;
-
-      for (long unsigned int j = 0; j < _systemParticles.size(); ++j)
+      for (long unsigned int j = i + 1; j < _systemParticles.size(); ++j)
       {
-        if (!_systemParticles[j].getVisible())
-          continue;
         _systemParticles[i].computeForce(_systemParticles[j], _func);
-        updated = true;
       }
 
-      if (!updated)
-      {
-        // all particles have been absorbed by p1, therefore they are not visible ==> the computeForce method in the loop
-        // above has not been called, and the force on p1 has not been updated ==> we need to update it here with a ghostParticle
-        NBodyEnv::Particle ghostParticle(NBodyEnv::gravitational, {0.0, 0.0, 0.0},
-                                         {0.0, 0.0, 0.0}, 0, 0);
-        _systemParticles[i].computeForce(ghostParticle, _func);
-        // should use a break here, but it's not possible in openmp
-        continue;
-      }
+      _discretizer.discretize(_systemParticles[i], _deltaTime);
     }
 
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-    // need to decouple the update of the position and velocity from the
-    // computation of the forces, for unknown reasons
-    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    _time += _deltaTime;
+  }
+
+
+  template <>
+  void System<VerletDiscretizer>::addParticle(Particle particle)
+  {
+    _systemParticles.push_back(particle);
+    _prevState.push_back(particle);
+    _mpi.markChanged();
+  }
+
+  template <>
+  const Particle &System<VerletDiscretizer>::getParticle(int index) const
+  {
+    return _systemParticles[index];
+  }
+
+  template <>
+  void System<VerletDiscretizer>::printParticles() const
+  {
+    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end(); iter++)
     {
-      if (_prevState[i].getPos().xPos == 0 && _prevState[i].getPos().yPos == 0 && _prevState[i].getPos().zPos == 0)
-      {
-        _discretizer.updateFirsePos(_systemParticles[i], _deltaTime);
-      }
-      else
-      {
-        _discretizer.updatePos(_systemParticles[i], _prevState[i], _deltaTime);
-      }
+      std::cout << "Particle number " << iter.base() << " in the system" << std::endl;
+    }
+  }
+
+  template <>
+  void System<VerletDiscretizer>::updateParticle(long unsigned int i, const std::vector<Particle> &state, bool stockGrav)
+  {
+    if (_systemParticles[i].getVisible())
+      _systemParticles[i].setForce(rowForce(i, state, stockGrav));
+    else
+      _systemParticles[i].setForce({0.0, 0.0, 0.0});
+
+    if (_prevState[i].getPos().xPos == 0 && _prevState[i].getPos().yPos == 0 && _prevState[i].getPos().zPos == 0)
+    {
+      _discretizer.updateFirsePos(_systemParticles[i], _deltaTime);
+    }
+    else
+    {
+      _discretizer.updatePos(_systemParticles[i], _prevState[i], _deltaTime);
     }
+  }
 
+  template <>
+  void System<VerletDiscretizer>::finishStep(std::vector<Particle> &state)
+  {
     // Update previous state
-    _prevState.clear();
-    std::copy(tempState.begin(), tempState.end(), _prevState.begin());
+    _prevState.swap(state);
+  }
+
+  template <>
+  void System<VerletDiscretizer>::compute()
+  {
+    stepParticles(false);
+  }
+
+  template <>
+  void System<VerletDiscretizer>::computeMPI()
+  {
+    stepParticles(true);
   }
 
 
   template <>
   void System<VerletDiscretizer>::computeSerial()
   {
-    // Save current state in a temp vector
-    std::vector<NBodyEnv::Particle> tempState(_systemParticles);
+    // Save current state
+    _snapshot = _systemParticles;
 
     // Reset forces
     for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
@@ -230,22 +604,20 @@ namespace NBodyEnv
       iter->setForce({0.0, 0.0, 0.0});
     }
 
-        for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    // Each pair is visited once, so the force on particle i is complete at the end of
+    // its row and i is never read again: it can be moved right away
+    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    {
+      if (_systemParticles[i].getVisible())
+      {
+        for (long unsigned int j = i + 1; j < _systemParticles.size(); ++j)
         {
-          if (!_systemParticles[i].getVisible())
+          if (!_systemParticles[j].getVisible())
             continue;
-          for (long unsigned int j = i + 1; j < _systemParticles.size(); ++j)
-          {
-            if (!_systemParticles[j].getVisible())
-              continue;
-            _systemParticles[i].computeForce(_systemParticles[j], _func);
-          }
+          _systemParticles[i].computeForce(_systemParticles[j], _func);
         }
+      }
 
-    // need to decouple the update of the position and velocity from the
-    // computation of the forces, for unknown reasons
-    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
-    {
       if (_prevState[i].getPos().xPos == 0 && _prevState[i].getPos().yPos == 0 && _prevState[i].getPos().zPos == 0)
       {
         _discretizer.updateFirsePos(_systemParticles[i], _deltaTime);
@@ -257,91 +629,81 @@ namespace NBodyEnv
     }
 
     // Update previous state
-    _prevState.clear();
-    std::copy(tempState.begin(), tempState.end(), _prevState.begin());
+    _prevState.swap(_snapshot);
+
+    _time += _deltaTime;
   }
 
 
-   template <>
+  template <>
   void System<EulerDiscretizer>::computeBH()
   {
-    // Reset forces both in the system and in the root and insert particles in the root
+    // Build the tree on the visible particles, it keeps its own copies of them
     m_root.ResetNode(m_root.GetMax(), m_root.GetMin());
 
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
-         iter++)
-    {
-      iter->setForce({0.0, 0.0, 0.0});
-    }
-
+    bool empty = true;
     for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
          iter++)
     {
+      if (!iter->getVisible())
+        continue;
       m_root.InsertParticle(*iter, 0);
+      empty = false;
     }
 
-    m_root.ComputeMass();
+    if (!empty)
+      m_root.ComputeMass();
 
+    // Single sweep: tree force of each particle, then the particle is updated
 #if defined(_OPENMP)
 #pragma omp parallel for schedule(static)
 #endif
-    for (int i = 0; i < m_root.GetNParticles(); ++i)
-    {
-      std::vector<double> force = m_root.ComputeForce(_systemParticles[i]);
-    }
-
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-    // need to decouple the update of the position and velocity from the
-    // computation of the forces, for unknown reasons
     for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
     {
+      if (!empty && _systemParticles[i].getVisible())
+        _systemParticles[i].setForce(treeForce(_systemParticles[i]));
+      else
+        _systemParticles[i].setForce({0.0, 0.0, 0.0});
+
       _discretizer.discretize(_systemParticles[i], _deltaTime);
     }
+
+    _time += _deltaTime;
   }
 
   template <>
   void System<VerletDiscretizer>::computeBH()
   {
-    // Reset forces both in the system and in the root and insert particles in the root
-    m_root.ResetNode(m_root.GetMax(), m_root.GetMin());
+    // Save current state
+    _snapshot = _systemParticles;
 
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
-         iter++)
-    {
-      iter->setForce({0.0, 0.0, 0.0});
-    }
+    // Build the tree on the visible particles, it keeps its own copies of them
+    m_root.ResetNode(m_root.GetMax(), m_root.GetMin());
 
+    bool empty = true;
     for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
          iter++)
     {
+      if (!iter->getVisible())
+        continue;
       m_root.InsertParticle(*iter, 0);
+      empty = false;
     }
-    
-    m_root.ComputeMass();
 
-#if defined(_OPENMP)
-#pragma omp parallel for schedule(static) 
-#endif
-    for (int i = 0; i < m_root.GetNParticles(); ++i)
-    {
-      std::vector<double> force = m_root.ComputeForce(_systemParticles[i]);
-    }
+    if (!empty)
+      m_root.ComputeMass();
 
+    // Single sweep: tree force of each particle, then the particle is updated
 #if defined(_OPENMP)
-#pragma omp parallel for
+#pragma omp parallel for schedule(static)
 #endif
-    // need to decouple the update of the position and velocity from the
-    // computation of the forces, for unknown reasons
     for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
     {
+      if (!empty && _systemParticles[i].getVisible())
+        _systemParticles[i].setForce(treeForce(_systemParticles[i]));
+      else
+        _systemParticles[i].setForce({0.0, 0.0, 0.0});
+
       if (_prevState[i].getPos().xPos == 0 && _prevState[i].getPos().yPos == 0 && _prevState[i].getPos().zPos == 0)
       {
         _discretizer.updateFirsePos(_systemParticles[i], _deltaTime);
@@ -351,6 +713,11 @@ namespace NBodyEnv
         _discretizer.updatePos(_systemParticles[i], _prevState[i], _deltaTime);
       }
     }
+
+    // Update previous state
+    _prevState.swap(_snapshot);
+
+    _time += _deltaTime;
   }
 
 
@@ -359,6 +726,7 @@ namespace NBodyEnv
   {
     _systemParticles.push_back(particle);
     _prevState.push_back(particle);
+    _mpi.markChanged();
   }
 
   template <>
@@ -377,246 +745,314 @@ namespace NBodyEnv
   }
 
   template <>
-  void System<RKDiscretizer>::compute()
+  void System<RKDiscretizer>::updateParticle(long unsigned int i, const std::vector<Particle> &state, bool)
   {
-    // Save current state in a temp vector
-    std::vector<NBodyEnv::Particle> tempState(_systemParticles);
-
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-    // Reset forces
-    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
-         iter++)
-    {
-      iter->setForce({0.0, 0.0, 0.0});
-    }
+    _systemParticles[i].setForce({0.0, 0.0, 0.0});
+    if (!_systemParticles[i].getVisible())
+      return;
 
     // boolean flag to make sure particle is updated in case all others have been absorbed
     bool updated = false;
 
-#if defined(_OPENMP)
-#pragma omp parallel for private(updated) schedule(static) 
-#endif
-    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    for (long unsigned int j = 0; j < _systemParticles.size(); ++j)
     {
-      if (!_systemParticles[i].getVisible())
+      if (!_systemParticles[j].getVisible() || j == i)
         continue;
-      updated = false;
 
-      for (long unsigned int j = 0; j < _systemParticles.size(); ++j)
-      {
-        if (!_systemParticles[j].getVisible() || j == i)
-          continue;
-    
-        _discretizer.discretize(_systemParticles[i], tempState[i], tempState[j], Functions::getGravFunction(), _deltaTime);
-        
-        updated = true;
-      }
+      _discretizer.discretize(_systemParticles[i], state[i], state[j], Functions::getGravFunction(), _deltaTime);
 
-      if (!updated)
-      {
-        // all particles have been absorbed by p1, therefore they are not visible ==> the computeForce method in the loop
-        // above has not been called, and the force on p1 has not been updated ==> we need to update it here with a ghostParticle
-        NBodyEnv::Particle ghostParticle(NBodyEnv::gravitational, {0.0, 0.0, 0.0},
-                                         {0.0, 0.0, 0.0}, 0, 0);
-        _discretizer.discretize(_systemParticles[i], tempState[i], ghostParticle, Functions::getGravFunction(), _deltaTime);
-        // should use a break here, but it's not possible in openmp
-        continue;
-      }
+      updated = true;
+    }
+
+    if (!updated)
+    {
+      // all particles have been absorbed by p1, therefore they are not visible ==> the computeForce method in the loop
+      // above has not been called, and the force on p1 has not been updated ==> we need to update it here with a ghostParticle
+      NBodyEnv::Particle ghostParticle(NBodyEnv::gravitational, {0.0, 0.0, 0.0},
+                                       {0.0, 0.0, 0.0}, 0, 0);
+      _discretizer.discretize(_systemParticles[i], state[i], ghostParticle, Functions::getGravFunction(), _deltaTime);
     }
   }
 
-  // MPI
   template <>
-  void System<RKDiscretizer>::computeMPI()
+  void System<RKDiscretizer>::implicitStep(bool distributed)
   {
-    // Get the number of processes
-    int world_size;
-    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    if (distributed)
+      _mpi.syncState(_systemParticles);
 
-    // Get the rank of the process
-    int world_rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    std::vector<Pos> &pos = _statePos;
+    std::vector<Vel> &vel = _stateVel;
+    loadState(pos, vel);
 
-    // Master
-    if (world_rank == 0) {
-      // Save current state in a temp vector
-      std::vector<NBodyEnv::Particle> tempState(_systemParticles);
-
-      // Reset forces in parallel threads if compiled with openMP
-      #if defined(_OPENMP)
-      #pragma omp parallel for
-      #endif
-      for (auto iter = _systemParticles.begin(); iter != _systemParticles.end();
-          iter++)
-      {
-        iter->setForce({0.0, 0.0, 0.0});
-      }
+    _discretizer.solveImplicit(
+        pos, vel,
+        [this, distributed](const std::vector<Pos> &stagePos, std::vector<Acc> &acc)
+        {
+          if (distributed)
+            mpiAcc(stagePos, acc);
+          else
+            directAcc(stagePos, acc, true);
+        },
+        [this, distributed](const std::vector<Pos> &stagePos, std::vector<std::array<double, 9>> &jac)
+        {
+          if (distributed)
+          {
+            directJac(stagePos, jac, _mpi.getBegin(), _mpi.getEnd());
+            _mpi.gather(jac);
+          }
+          else
+            directJac(stagePos, jac);
+        },
+        _deltaTime);
 
-      // Serialize particles
-      std::string serialConversion;
+    storeState(pos, vel);
+    _time += _deltaTime;
+  }
 
-      boost::iostreams::back_insert_device<std::string> inserter(serialConversion);
-      boost::iostreams::stream<boost::iostreams::back_insert_device<std::string> > s(inserter);
-      boost::archive::binary_oarchive send_ar(s);
+  template <>
+  void System<RKDiscretizer>::compute()
+  {
+    // Implicit tables can't be evaluated pairwise, solve the stage equations on the whole system
+    if (_discretizer.isImplicit())
+      implicitStep(false);
+    else
+      stepParticles(false);
+  }
 
-      send_ar << _systemParticles;
-      s.flush();
-      int len = serialConversion.size();
+  template <>
+  void System<AdaptiveRKDiscretizer>::addParticle(Particle particle)
+  {
+    _systemParticles.push_back(particle);
+    _prevState.push_back(particle);
+    _mpi.markChanged();
+  }
 
-      // Send to others
-      for (int i = world_rank + 1; i < world_size; i++) {
-        MPI_Send( &len, 1, MPI_INT, i, 0, MPI_COMM_WORLD );
-        MPI_Send( (void *)serialConversion.data(), len, MPI_BYTE, i, 0, MPI_COMM_WORLD );
-      }
-        
-      // Receive from others
-      for (int i = world_rank + 1; i < world_size; i++) {
-        // Receive len
-        int serialLen;
-        MPI_Recv( &serialLen, 1, MPI_INT, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        // Receive data
-        char data[len+1];
-        MPI_Recv( data, len, MPI_BYTE, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        data[len] = '\0';
-
-        // Unserialize all
-        std::vector<NBodyEnv::Particle> temp;
-        boost::iostreams::basic_array_source<char> device(data, len);
-        boost::iostreams::stream<boost::iostreams::basic_array_source<char> > s(device);
-        boost::archive::binary_iarchive recv_ar(s);
-
-        recv_ar >> temp;
-
-        // Get positions
-        int numParts = _systemParticles.size() / (world_size - 1); // As for workers. Master node doesn't worw
-        
-        size_t initVec = numParts * (i - 1);
-        size_t endVec = numParts * i - 1;
-    
-        if(numParts == 0 && i == 1){
-          initVec = 0;
-          endVec = _systemParticles.size() - 1;
-        }
+  template <>
+  const Particle &System<AdaptiveRKDiscretizer>::getParticle(int index) const
+  {
+    return _systemParticles[index];
+  }
 
-        if(numParts == 0 && i != 1)
-          continue;
+  template <>
+  void System<AdaptiveRKDiscretizer>::printParticles() const
+  {
+    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end(); iter++)
+    {
+      std::cout << "Particle number " << iter.base() << " in the system" << std::endl;
+    }
+  }
 
-        // Last node has always endVec = end of the vector
-        if(i == world_size - 1)
-          endVec = _systemParticles.size() - 1;
-        
-        // Update 
-        for(size_t j = initVec; j <= endVec; j++)
-          _systemParticles[j] = temp[j - initVec];
-        
+  template <>
+  void System<AdaptiveRKDiscretizer>::integrate(const AccFunction &accFunc)
+  {
+    std::vector<Pos> &pos = _statePos;
+    std::vector<Vel> &vel = _stateVel;
+    loadState(pos, vel);
 
-        // End work
-      }
-    } else { // Others
+    // The step is shortened if needed to land exactly on the stop time
+    double maxStep = _stopTime > _time ? _stopTime - _time : INFINITY;
+    double step = _discretizer.step(pos, vel, accFunc, _deltaTime, maxStep);
+    _time = step == maxStep ? _stopTime : _time + step;
 
-      // Receive len
-      int len;
-      MPI_Recv( &len, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    storeState(pos, vel);
 
-      // Receive data
-      char data[len+1];
-      MPI_Recv( data, len, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      data[len] = '\0';
+    const std::vector<Acc> &acc = _discretizer.getAcc();
 
-      // Unserialize all
-      boost::iostreams::basic_array_source<char> device(data, len);
-      boost::iostreams::stream<boost::iostreams::basic_array_source<char> > s(device);
-      boost::archive::binary_iarchive recv_ar(s);
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    {
+      double mass = _systemParticles[i].getSpecInfo();
+      _systemParticles[i].setForce({acc[i].xAcc * mass, acc[i].yAcc * mass, acc[i].zAcc * mass});
+    }
+  }
 
-      recv_ar >> _systemParticles;
+  template <>
+  void System<AdaptiveRKDiscretizer>::compute()
+  {
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { directAcc(pos, acc, true); });
+  }
 
-      std::vector<NBodyEnv::Particle> tempState(_systemParticles);
+  template <>
+  void System<AdaptiveRKDiscretizer>::computeSerial()
+  {
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { directAcc(pos, acc, false); });
+  }
 
-      // Calculate number of particles
-      int numParts = _systemParticles.size() / (world_size - 1); // Master node doesn't work
+  template <>
+  void System<AdaptiveRKDiscretizer>::computeBH()
+  {
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { treeAcc(pos, acc); });
+  }
 
-      // If the first node has numParts = 0 there are too few particles for the number all nodes.
-      // All computation will be done by the first one
-      if(numParts == 0 && world_rank == 1)
-        numParts = _systemParticles.size();
+  template <>
+  void System<AdaptiveRKDiscretizer>::computeMPI()
+  {
+    _mpi.syncState(_systemParticles);
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { mpiAcc(pos, acc); });
+  }
 
-      if(numParts == 0 && world_rank != 1)
-        return;
+  template <>
+  void System<AdaptiveRKDiscretizer>::computeBHMPI()
+  {
+    _mpi.syncState(_systemParticles);
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { bhmpiAcc(pos, acc); });
+  }
 
-      size_t initVec = numParts * (world_rank - 1);
-      size_t endVec = numParts * world_rank - 1;
+  template <>
+  void System<SymplecticDiscretizer>::addParticle(Particle particle)
+  {
+    _systemParticles.push_back(particle);
+    _prevState.push_back(particle);
+    _mpi.markChanged();
+  }
 
-      // Last node has always endVec = end of the vector
-      if(world_rank == world_size - 1)
-        endVec = _systemParticles.size() - 1;
+  template <>
+  const Particle &System<SymplecticDiscretizer>::getParticle(int index) const
+  {
+    return _systemParticles[index];
+  }
 
-      
-      // And now compute
+  template <>
+  void System<SymplecticDiscretizer>::printParticles() const
+  {
+    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end(); iter++)
+    {
+      std::cout << "Particle number " << iter.base() << " in the system" << std::endl;
+    }
+  }
 
-      // boolean flag to make sure particle is updated in case all others have been absorbed
-      bool updated = false;
+  template <>
+  void System<SymplecticDiscretizer>::integrate(const AccFunction &accFunc)
+  {
+    std::vector<Pos> &pos = _statePos;
+    std::vector<Vel> &vel = _stateVel;
+    loadState(pos, vel);
 
-      // Here we use also openmp. If the library is compiled with it, we are going to use multiprocessor (or multi-node
-      // in a cluster) and multi-threading
-      #if defined(_OPENMP)
-      #pragma omp parallel for private(updated) schedule(static) /*collapse(2)*/
-      #endif
-      for (size_t i = initVec; i <= endVec; ++i)
-      {
-        if (!_systemParticles[i].getVisible())
-          continue;
-        updated = false;
+    _discretizer.step(pos, vel, accFunc, _deltaTime);
+    storeState(pos, vel);
+    _time += _deltaTime;
+  }
 
-        for (long unsigned int j = 0; j < _systemParticles.size(); ++j)
-        {
-          if (!_systemParticles[j].getVisible() || j == i)
-            continue;
-      
-          _discretizer.discretize(_systemParticles[i], tempState[i], tempState[j], Functions::getGravFunction(), _deltaTime);
-          
-          updated = true;
-        }
+  template <>
+  void System<SymplecticDiscretizer>::compute()
+  {
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { directAcc(pos, acc, true); });
+  }
 
-        if (!updated)
-        {
-          // all particles have been absorbed by p1, therefore they are not visible ==> the computeForce method in the loop
-          // above has not been called, and the force on p1 has not been updated ==> we need to update it here with a ghostParticle
-          NBodyEnv::Particle ghostParticle(NBodyEnv::gravitational, {0.0, 0.0, 0.0},
-                                          {0.0, 0.0, 0.0}, 0, 0);
-          _discretizer.discretize(_systemParticles[i], tempState[i], ghostParticle, Functions::getGravFunction(), _deltaTime);
-          // should use a break here, but it's not possible in openmp
-          continue;
-        }
-      }
+  template <>
+  void System<SymplecticDiscretizer>::computeSerial()
+  {
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { directAcc(pos, acc, false); });
+  }
 
-      // Now we have to send contribute back to master
-      // Extract only computed particles
-      auto first = _systemParticles.begin() + initVec;
-      auto last  = _systemParticles.begin() + endVec + 1;
+  template <>
+  void System<SymplecticDiscretizer>::computeBH()
+  {
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { treeAcc(pos, acc); });
+  }
 
-      std::vector<Particle> toReturn(first, last);
+  template <>
+  void System<SymplecticDiscretizer>::computeMPI()
+  {
+    _mpi.syncState(_systemParticles);
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { mpiAcc(pos, acc); });
+  }
 
-      // Serialize vector
-      std::string serialConversion;
+  template <>
+  void System<SymplecticDiscretizer>::computeBHMPI()
+  {
+    _mpi.syncState(_systemParticles);
+    integrate([this](const std::vector<Pos> &pos, std::vector<Acc> &acc)
+              { bhmpiAcc(pos, acc); });
+  }
 
-      boost::iostreams::back_insert_device<std::string> inserter(serialConversion);
-      boost::iostreams::stream<boost::iostreams::back_insert_device<std::string> > s2(inserter);
-      boost::archive::binary_oarchive send_ar(s2);
+  template <>
+  void System<HermiteDiscretizer>::addParticle(Particle particle)
+  {
+    _systemParticles.push_back(particle);
+    _prevState.push_back(particle);
+    _mpi.markChanged();
+  }
 
-      send_ar << toReturn;
-      s2.flush();
-      len = serialConversion.size();
+  template <>
+  const Particle &System<HermiteDiscretizer>::getParticle(int index) const
+  {
+    return _systemParticles[index];
+  }
 
-      // Send to master legnth of serialized string
-      MPI_Send(&len, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+  template <>
+  void System<HermiteDiscretizer>::printParticles() const
+  {
+    for (auto iter = _systemParticles.begin(); iter != _systemParticles.end(); iter++)
+    {
+      std::cout << "Particle number " << iter.base() << " in the system" << std::endl;
+    }
+  }
+
+  template <>
+  void System<HermiteDiscretizer>::integrateJerk(const AccJerkFunction &accJerkFunc)
+  {
+    std::vector<Pos> &pos = _statePos;
+    std::vector<Vel> &vel = _stateVel;
+    loadState(pos, vel);
 
-      // Send to master serialized vector
-      MPI_Send( (void *)serialConversion.data(), len, MPI_BYTE, 0, 0, MPI_COMM_WORLD );
+    _discretizer.step(pos, vel, accJerkFunc, _deltaTime);
+    storeState(pos, vel);
 
-      // Work ended
+    const std::vector<Acc> &acc = _discretizer.getAcc();
+
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (long unsigned int i = 0; i < _systemParticles.size(); ++i)
+    {
+      double mass = _systemParticles[i].getSpecInfo();
+      _systemParticles[i].setForce({acc[i].xAcc * mass, acc[i].yAcc * mass, acc[i].zAcc * mass});
     }
+
+    _time += _deltaTime;
+  }
+
+  template <>
+  void System<HermiteDiscretizer>::compute()
+  {
+    integrateJerk([this](const std::vector<Pos> &pos, const std::vector<Vel> &vel, std::vector<Acc> &acc, std::vector<Jerk> &jerk)
+                  { directAccJerk(pos, vel, acc, jerk, true); });
+  }
+
+  template <>
+  void System<HermiteDiscretizer>::computeSerial()
+  {
+    integrateJerk([this](const std::vector<Pos> &pos, const std::vector<Vel> &vel, std::vector<Acc> &acc, std::vector<Jerk> &jerk)
+                  { directAccJerk(pos, vel, acc, jerk, false); });
+  }
+
+  template <>
+  void System<HermiteDiscretizer>::computeMPI()
+  {
+    _mpi.syncState(_systemParticles);
+    integrateJerk([this](const std::vector<Pos> &pos, const std::vector<Vel> &vel, std::vector<Acc> &acc, std::vector<Jerk> &jerk)
+                  { mpiAccJerk(pos, vel, acc, jerk); });
+  }
+
+  // MPI
+  template <>
+  void System<RKDiscretizer>::computeMPI()
+  {
+    if (_discretizer.isImplicit())
+      implicitStep(true);
+    else
+      stepParticles(true);
   }
 } // namespace NBodyEnv
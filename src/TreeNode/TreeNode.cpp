@@ -2,6 +2,7 @@
 #include <iostream>
 #include <sstream>
 #include <cassert>
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -442,6 +443,49 @@ namespace NBodyEnv
         return acc;
     }
 
+    void TreeNode::ExportEssential(const std::vector<double> &max, const std::vector<double> &min, std::vector<double> &essential) const
+    {
+        if (m_nParticles == 0)
+        {
+            return;
+        }
+
+        // a leaf is sent as it is
+        if (m_nParticles == 1)
+        {
+            essential.insert(essential.end(), {m_particle.getPos().xPos, m_particle.getPos().yPos, m_particle.getPos().zPos, m_totMass,
+                                               m_particle.getRadius()});
+            return;
+        }
+
+        // closest distance between the box and the center of mass of the node
+        double r = 0.0;
+        for (int k = 0; k < 3; ++k)
+        {
+            double outside = std::max({min[k] - m_cm[k], m_cm[k] - max[k], 0.0});
+            r += outside * outside;
+        }
+        r = sqrt(r);
+
+        // node width
+        double d = m_max[0] - m_min[0];
+
+        // the node is far enough from every particle of the box, same criterion as ComputeForce
+        if (r > 0.0 && (d / r) <= m_theta)
+        {
+            essential.insert(essential.end(), {m_cm[0], m_cm[1], m_cm[2], m_totMass, 0.0});
+            return;
+        }
+
+        for (int q = 0; q < 8; ++q)
+        {
+            if (m_octant[q])
+            {
+                m_octant[q]->ExportEssential(max, min, essential);
+            }
+        }
+    }
+
     std::vector<double> TreeNode::ComputeAcc(const Particle &p1, const Particle &p2) const
     {
         std::vector<double> acc = {0.0, 0.0, 0.0};
@@ -464,6 +508,12 @@ namespace NBodyEnv
                         (y1 - y2) * (y1 - y2) +
                         (z1 - z2) * (z1 - z2));
 
+        // no force inside the collision radius, same as the direct sum (getGravAcc)
+        if (r <= p1.getRadius() + p2.getRadius())
+        {
+            return acc;
+        }
+
         double k = m_G * m2 / (r * r * r);
 
         acc[0] += k * (x2 - x1);
@@ -0,0 +1,134 @@
+// Writes the text output with positions and velocities at different cadences, then reads it
+// back through the field list of each state header and through the Parser of utilities,
+// which must find the states that hold positions only
+#include <N-Body-sim.hpp>
+#include <Parser.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr int numParticles = 5;
+constexpr int numStates = 5;
+constexpr double deltaTime = 0.5;
+// The text output has 6 significant digits
+constexpr double tolerance = 1.0e-5;
+
+bool failed = false;
+
+void check(bool passed, const std::string &what) {
+  if (!passed) {
+    std::printf("FAILED %s\n", what.c_str());
+    failed = true;
+  }
+}
+
+bool close(double value, double expected) {
+  return std::fabs(value - expected) <= tolerance * std::max(1.0, std::fabs(expected));
+}
+} // namespace
+
+int main() {
+  NBodyEnv::System<NBodyEnv::EulerDiscretizer> system(NBodyEnv::Functions::getGravFunc(),
+                                                      NBodyEnv::EulerDiscretizer(), deltaTime);
+  for (int i = 0; i < numParticles; ++i)
+    system.addParticle(NBodyEnv::Particle(NBodyEnv::gravitational, {10.0 * i, 3.0 - i, 0.5 * i * i},
+                                          {0.1 * i, -0.2, 0.0}, 1.0e10 * (i + 1), 0.1));
+
+  const std::string path = "exporter_test.part";
+  std::remove((path + ".idx").c_str());
+
+  // Positions every other state, velocities at every state
+  std::vector<std::vector<NBodyEnv::Particle>> states;
+  {
+    NBodyEnv::Exporter exporter(path, deltaTime);
+    NBodyEnv::ExportSpec spec;
+    spec.fields = EXPORT_POS | EXPORT_VEL;
+    spec.posEvery = 2;
+    exporter.setSpec(spec);
+
+    for (int state = 0; state < numStates; ++state) {
+      states.push_back(system.getParticles());
+      exporter.saveState(system.getParticles());
+      system.compute();
+    }
+    exporter.close();
+  }
+
+  // The header of each state lists the fields of its lines
+  std::ifstream file(path);
+  std::string line;
+  int state = -1;
+  bool hasPos = false;
+  int row = 0;
+  while (std::getline(file, line)) {
+    std::istringstream tokens(line);
+    if (line.compare(0, 3, "---") == 0) {
+      ++state;
+      row = 0;
+      tokens.ignore(3);
+      double time;
+      tokens >> time;
+      check(close(time, state * deltaTime), "time of state " + std::to_string(state));
+
+      std::vector<std::string> fields;
+      std::string field;
+      while (tokens >> field)
+        fields.push_back(field);
+      hasPos = state % 2 == 0;
+      std::vector<std::string> expected = hasPos ? std::vector<std::string>{"pos", "vel"}
+                                                 : std::vector<std::string>{"vel"};
+      check(fields == expected, "fields of state " + std::to_string(state) + ": " + line);
+      continue;
+    }
+
+    if (state < 0 || row >= numParticles) {
+      check(false, "line outside a state: " + line);
+      continue;
+    }
+    std::string name;
+    tokens >> name;
+    check(name == "PART" + std::to_string(row), "name of row " + std::to_string(row));
+    const NBodyEnv::Particle &particle = states[state][row];
+    double x, y, z;
+    if (hasPos) {
+      tokens >> x >> y >> z;
+      const NBodyEnv::Pos &pos = particle.getPos();
+      check(close(x, pos.xPos) && close(y, pos.yPos) && close(z, pos.zPos),
+            "position in state " + std::to_string(state));
+    }
+    tokens >> x >> y >> z;
+    const NBodyEnv::Vel &vel = particle.getVel();
+    check(close(x, vel.xVel) && close(y, vel.yVel) && close(z, vel.zVel),
+          "velocity in state " + std::to_string(state));
+    std::string extra;
+    check(!(tokens >> extra), "nothing after the fields of state " + std::to_string(state));
+    ++row;
+  }
+  check(state == numStates - 1, "number of states");
+
+  // The Parser reads the positions of the states 0, 2 and 4 only
+  {
+    Parser parser(path, deltaTime, 0);
+    check(parser.getFrames() == (numStates + 1) / 2, "frames found by the Parser");
+    for (size_t frame = 0; frame < parser.getFrames() && 2 * frame < states.size(); ++frame) {
+      check(close(parser.getTime(frame), 2 * frame * deltaTime), "time of frame " + std::to_string(frame));
+      const std::vector<Vec> &positions = parser.getFrame(frame);
+      check(positions.size() == numParticles, "particles of frame " + std::to_string(frame));
+      for (size_t i = 0; i < positions.size(); ++i) {
+        const NBodyEnv::Pos &pos = states[2 * frame][i].getPos();
+        check(close(positions[i].x, pos.xPos) && close(positions[i].y, pos.yPos) && close(positions[i].z, pos.zPos),
+              "Parser position in frame " + std::to_string(frame));
+      }
+    }
+  }
+
+  std::remove(path.c_str());
+  std::remove((path + ".idx").c_str());
+
+  std::printf("%-28s %s\n", "text fields", failed ? "FAILED" : "ok");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+// Runs the MPI versions of the integrators against the shared-memory ones on the same
+// particles and checks that the final positions agree. Every rank reports the time spent
+// in the distributed steps and the bytes it sent, counted through the MPI profiling
+// interface (the MPI calls of the library land in the wrappers below)
+#include <N-Body-sim.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+unsigned long long sentBytes = 0;
+// Bytes of each persistent send, counted at every MPI_Start
+std::map<MPI_Request, unsigned long long> persistentBytes;
+
+unsigned long long bytes(MPI_Datatype type, long long count) {
+  int size;
+  PMPI_Type_size(type, &size);
+  return size * count;
+}
+
+int commRank(MPI_Comm comm) {
+  int rank;
+  PMPI_Comm_rank(comm, &rank);
+  return rank;
+}
+
+int commSize(MPI_Comm comm) {
+  int size;
+  PMPI_Comm_size(comm, &size);
+  return size;
+}
+} // namespace
+
+// Collectives count what this rank contributes to each of the other ranks
+int MPI_Bcast(void *buffer, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+  if (commRank(comm) == root)
+    sentBytes += bytes(type, count) * (commSize(comm) - 1);
+  return PMPI_Bcast(buffer, count, type, root, comm);
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type, MPI_Op op,
+                  MPI_Comm comm) {
+  if (commSize(comm) > 1)
+    sentBytes += bytes(type, count);
+  return PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf,
+                  int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+  unsigned long long own = sendbuf == MPI_IN_PLACE ? bytes(recvtype, recvcount) : bytes(sendtype, sendcount);
+  sentBytes += own * (commSize(comm) - 1);
+  return PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+}
+
+int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf,
+                   const int recvcounts[], const int displs[], MPI_Datatype recvtype, MPI_Comm comm) {
+  unsigned long long own = sendbuf == MPI_IN_PLACE ? bytes(recvtype, recvcounts[commRank(comm)])
+                                                   : bytes(sendtype, sendcount);
+  sentBytes += own * (commSize(comm) - 1);
+  return PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm);
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf,
+                 int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+  sentBytes += bytes(sendtype, sendcount) * (commSize(comm) - 1);
+  return PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+}
+
+int MPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype,
+                  void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype,
+                  MPI_Comm comm) {
+  int rank = commRank(comm);
+  for (int other = 0; other < commSize(comm); ++other) {
+    if (other != rank)
+      sentBytes += bytes(sendtype, sendcounts[other]);
+  }
+  return PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm);
+}
+
+int MPI_Send_init(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm,
+                  MPI_Request *request) {
+  int result = PMPI_Send_init(buf, count, type, dest, tag, comm, request);
+  persistentBytes[*request] = bytes(type, count);
+  return result;
+}
+
+int MPI_Start(MPI_Request *request) {
+  auto found = persistentBytes.find(*request);
+  if (found != persistentBytes.end())
+    sentBytes += found->second;
+  return PMPI_Start(request);
+}
+
+int MPI_Request_free(MPI_Request *request) {
+  persistentBytes.erase(*request);
+  return PMPI_Request_free(request);
+}
+
+namespace {
+constexpr int numParticles = 97;
+constexpr int numSteps = 10;
+
+int rank = 0;
+int size = 1;
+bool failed = false;
+
+// Same particles on every rank, at rest so that the displacements come from the forces only
+template <class T>
+NBodyEnv::System<T> makeSystem(T discretizer,
+                               std::function<void(NBodyEnv::Particle &, NBodyEnv::Particle &)> func =
+                                   NBodyEnv::Functions::getGravFunc()) {
+  NBodyEnv::System<T> system(func, discretizer, 1.0);
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<> distr(-1000.0, 1000.0);
+  std::uniform_real_distribution<> massDistr(1.0e11, 1.0e12);
+  for (int i = 0; i < numParticles; i++) {
+    NBodyEnv::Particle particle(NBodyEnv::gravitational, {distr(gen), distr(gen), distr(gen)},
+                                {0.0, 0.0, 0.0}, massDistr(gen), 1.0);
+    system.addParticle(particle);
+  }
+  return system;
+}
+
+// Advance a copy of expected with the shared-memory step and a copy of system with the
+// distributed one, the rms position difference relative to the rms displacement must be
+// below tolerance
+template <class T, class Setup, class Reference, class Distributed>
+void check(const std::string &name, const NBodyEnv::System<T> &system, NBodyEnv::System<T> expected,
+           Setup setup, Reference reference, Distributed distributed, double tolerance) {
+  NBodyEnv::System<T> actual(system);
+  setup(actual);
+
+  for (int step = 0; step < numSteps; ++step)
+    reference(expected);
+
+  unsigned long long startBytes = sentBytes;
+  double start = MPI_Wtime();
+  for (int step = 0; step < numSteps; ++step)
+    distributed(actual);
+  double time = MPI_Wtime() - start;
+  unsigned long long sent = sentBytes - startBytes;
+
+  double error = 0.0;
+  double displacement = 0.0;
+  for (int i = 0; i < numParticles; ++i) {
+    NBodyEnv::Pos initial = system.getParticle(i).getPos();
+    NBodyEnv::Pos exact = expected.getParticle(i).getPos();
+    NBodyEnv::Pos pos = actual.getParticle(i).getPos();
+    error += (pos.xPos - exact.xPos) * (pos.xPos - exact.xPos) + (pos.yPos - exact.yPos) * (pos.yPos - exact.yPos) +
+             (pos.zPos - exact.zPos) * (pos.zPos - exact.zPos);
+    displacement += (exact.xPos - initial.xPos) * (exact.xPos - initial.xPos) +
+                    (exact.yPos - initial.yPos) * (exact.yPos - initial.yPos) +
+                    (exact.zPos - initial.zPos) * (exact.zPos - initial.zPos);
+  }
+  error = std::sqrt(error / displacement);
+
+  // Worst rank decides, rank 0 prints the report of all of them
+  double worst;
+  PMPI_Allreduce(&error, &worst, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  std::vector<double> times(size);
+  std::vector<unsigned long long> sents(size);
+  PMPI_Gather(&time, 1, MPI_DOUBLE, times.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  PMPI_Gather(&sent, 1, MPI_UNSIGNED_LONG_LONG, sents.data(), 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+
+  bool passed = worst <= tolerance;
+  failed = failed || !passed;
+
+  if (rank == 0) {
+    std::printf("%-28s %s  error %.3e (tolerance %.1e)\n", name.c_str(), passed ? "ok    " : "FAILED", worst,
+                tolerance);
+    for (int other = 0; other < size; ++other)
+      std::printf("    rank %d: %9.3f ms, %10llu bytes sent\n", other, times[other] * 1.0e3, sents[other]);
+  }
+}
+
+template <class T> void none(NBodyEnv::System<T> &) {}
+} // namespace
+
+int main(int argc, char **argv) {
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  if (rank == 0)
+    std::printf("%d ranks, %d particles, %d steps\n", size, numParticles, numSteps);
+
+  // Distributed direct sums are exact up to rounding
+  constexpr double exact = 1.0e-9;
+
+  // computeSerial visits each pair once and needs the symmetric force
+  auto euler = makeSystem(NBodyEnv::EulerDiscretizer());
+  auto eulerSerial = makeSystem(NBodyEnv::EulerDiscretizer(), NBodyEnv::Functions::getGravSerialFunc());
+  check("euler", euler, eulerSerial, none<NBodyEnv::EulerDiscretizer>, [](auto &s) { s.computeSerial(); },
+        [](auto &s) { s.computeMPI(); }, exact);
+
+  auto verlet = makeSystem(NBodyEnv::VerletDiscretizer());
+  auto verletSerial = makeSystem(NBodyEnv::VerletDiscretizer(), NBodyEnv::Functions::getGravSerialFunc());
+  check("verlet", verlet, verletSerial, none<NBodyEnv::VerletDiscretizer>, [](auto &s) { s.computeSerial(); },
+        [](auto &s) { s.computeMPI(); }, exact);
+  check("verlet float deltas", verlet, verletSerial, [](auto &s) { s.setMPIFloatDeltas(true); },
+        [](auto &s) { s.computeSerial(); }, [](auto &s) { s.computeMPI(); }, 1.0e-5);
+
+  auto rk = makeSystem(NBodyEnv::RKDiscretizer(DISC_RK4));
+  check("rk4", rk, rk, none<NBodyEnv::RKDiscretizer>, [](auto &s) { s.compute(); },
+        [](auto &s) { s.computeMPI(); }, exact);
+  // Implicit tables solve the stage equations on the whole system
+  auto midpoint = makeSystem(NBodyEnv::RKDiscretizer(DISC_IMPMID));
+  check("implicit midpoint", midpoint, midpoint, none<NBodyEnv::RKDiscretizer>, [](auto &s) { s.compute(); },
+        [](auto &s) { s.computeMPI(); }, exact);
+
+  auto dopri = makeSystem(NBodyEnv::AdaptiveRKDiscretizer(DISC_DOPRI5));
+  check("dopri5", dopri, dopri, none<NBodyEnv::AdaptiveRKDiscretizer>, [](auto &s) { s.compute(); },
+        [](auto &s) { s.computeMPI(); }, exact);
+
+  auto yoshida = makeSystem(NBodyEnv::SymplecticDiscretizer(DISC_YOSHIDA4));
+  check("yoshida4 allgather", yoshida, yoshida, none<NBodyEnv::SymplecticDiscretizer>, [](auto &s) { s.computeSerial(); },
+        [](auto &s) { s.computeMPI(); }, exact);
+  check("yoshida4 ring", yoshida, yoshida, [](auto &s) { s.setMPIEngine(MPIENGINE_RING); },
+        [](auto &s) { s.computeSerial(); }, [](auto &s) { s.computeMPI(); }, exact);
+  // Barnes-Hut approximates the forces, the distributed trees differ from the shared one
+  check("yoshida4 barnes-hut", yoshida, yoshida, none<NBodyEnv::SymplecticDiscretizer>, [](auto &s) { s.computeSerial(); },
+        [](auto &s) { s.computeBHMPI(); }, 1.0e-1);
+
+  auto hermite = makeSystem(NBodyEnv::HermiteDiscretizer());
+  check("hermite", hermite, hermite, none<NBodyEnv::HermiteDiscretizer>, [](auto &s) { s.computeSerial(); },
+        [](auto &s) { s.computeMPI(); }, exact);
+
+  MPI_Finalize();
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,10 +1,21 @@
 #ifndef PART_PARSER
 #define PART_PARSER
 
-#include <vector>
-#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 struct Vec
 {
@@ -13,108 +24,357 @@ struct Vec
     double z;
 };
 
+// Reads the .part files of the Exporter ("---<time> <fields>" followed by a "PART<i> x y z ..."
+// line for each particle) one frame at a time. The first open scans the file for the frames and
+// saves their time, offset and number of particles in <path>.idx, later opens read the index only.
+// Frames without positions, written when other fields have a shorter cadence, are skipped.
+// Frames are read on demand and a background thread parses the next ones in advance
 class Parser
 {
 public:
-    Parser(std::string path, double deltaTime)
+    // prefetch is the number of frames after the last requested one read in advance
+    Parser(std::string path, double deltaTime, size_t prefetch = 2)
+        : m_path(path), m_deltaTime(deltaTime), m_prefetch(prefetch)
     {
-        m_partFile.open(path);
-        m_deltaTime = deltaTime;
-        parse();
+        m_partFile.open(path, std::ios::binary);
+        if (!m_partFile)
+            throw std::runtime_error("Parser: cannot open " + path);
+
+        if (!loadIndex())
+        {
+            buildIndex();
+            saveIndex();
+        }
+
+        if (m_prefetch > 0)
+            m_worker = std::thread(&Parser::prefetchLoop, this);
     }
 
-    std::vector<std::vector<Vec>> getParticles() { return m_parsed; }
-    std::vector<double> getTime() { return m_timePassed; }
+    Parser(const Parser &) = delete;
+    Parser &operator=(const Parser &) = delete;
+
+    ~Parser()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_changed.notify_all();
+        if (m_worker.joinable())
+            m_worker.join();
+    }
+
+    size_t getFrames() const { return m_frames.size(); }
+    double getTime(size_t frame) const { return m_frames.at(frame).time; }
+    size_t getCount(size_t frame) const { return m_frames.at(frame).count; }
+
+    // Positions of the particles at frame, valid until the next call
+    const std::vector<Vec> &getFrame(size_t frame)
+    {
+        if (frame >= m_frames.size())
+            throw std::out_of_range("Parser: no frame " + std::to_string(frame));
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // The worker may be parsing it already
+        m_changed.wait(lock, [this, frame]
+                       { return m_loading != frame; });
+
+        auto ready = m_ready.find(frame);
+        if (ready != m_ready.end())
+        {
+            m_current = std::move(ready->second);
+            m_ready.erase(ready);
+        }
+        else
+        {
+            lock.unlock();
+            readFrame(m_partFile, frame, m_current);
+            lock.lock();
+        }
+
+        // Keep only the frames of the new prefetch window
+        m_next = frame + 1;
+        for (auto iter = m_ready.begin(); iter != m_ready.end();)
+        {
+            if (iter->first < m_next || iter->first >= m_next + m_prefetch)
+                iter = m_ready.erase(iter);
+            else
+                ++iter;
+        }
+        lock.unlock();
+        m_changed.notify_all();
+
+        return m_current;
+    }
+
+    std::vector<double> getTime() const
+    {
+        std::vector<double> times;
+        for (const Frame &frame : m_frames)
+            times.push_back(frame.time);
+        return times;
+    }
+
+    // All the frames at once, only for files that fit in memory
+    std::vector<std::vector<Vec>> getParticles()
+    {
+        std::vector<std::vector<Vec>> parsed(m_frames.size());
+        for (size_t frame = 0; frame < m_frames.size(); ++frame)
+            parsed[frame] = getFrame(frame);
+        return parsed;
+    }
 
 private:
+    struct Frame
+    {
+        double time;
+        // Offset of the first line after "---<time>" and of the end of the frame
+        std::uint64_t begin;
+        std::uint64_t end;
+        std::uint64_t count;
+        // The lines start with the positions
+        std::uint64_t positions;
+    };
+
+    static constexpr char indexMagic[8] = {'N', 'B', 'O', 'D', 'Y', 'I', 'D', 'X'};
+    static constexpr std::uint32_t indexVersion = 2;
+
+    std::string m_path;
     std::ifstream m_partFile;
-    std::vector<std::vector<Vec>> m_parsed;
-    std::vector<double> m_timePassed;
-    int m_numStep;
-    int m_particleIndex;
     double m_deltaTime;
+    std::vector<Frame> m_frames;
+
+    std::vector<Vec> m_current;
 
-    void parse()
+    // Prefetching: frames in [m_next, m_next + m_prefetch) are parsed by the worker
+    size_t m_prefetch;
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::map<size_t, std::vector<Vec>> m_ready;
+    size_t m_next = 0;
+    size_t m_loading = SIZE_MAX;
+    bool m_stop = false;
+
+    std::string indexPath() const { return m_path + ".idx"; }
+
+    // The index is used if it was built from a file with the same size and date
+    std::uint64_t fileStamp() const
     {
-        std::string line;
-        std::vector<Vec> tempVec;
-        m_numStep = -1;
+        return std::filesystem::last_write_time(m_path).time_since_epoch().count();
+    }
 
-        if (m_partFile.is_open())
+    bool loadIndex()
+    {
+        std::ifstream index(indexPath(), std::ios::binary);
+        char magic[8];
+        std::uint32_t version;
+        std::uint64_t size, stamp, frames;
+        if (!index.read(magic, sizeof(magic)) || std::memcmp(magic, indexMagic, sizeof(magic)) != 0 ||
+            !index.read(reinterpret_cast<char *>(&version), sizeof(version)) || version != indexVersion ||
+            !index.read(reinterpret_cast<char *>(&size), sizeof(size)) ||
+            !index.read(reinterpret_cast<char *>(&stamp), sizeof(stamp)) ||
+            !index.read(reinterpret_cast<char *>(&frames), sizeof(frames)))
+            return false;
+        if (size != std::filesystem::file_size(m_path) || stamp != fileStamp())
+            return false;
+
+        m_frames.resize(frames);
+        if (!index.read(reinterpret_cast<char *>(m_frames.data()), frames * sizeof(Frame)))
         {
-            while (m_partFile)
-            {
-                std::getline(m_partFile, line);
+            m_frames.clear();
+            return false;
+        }
+        return true;
+    }
 
-                if (line.length() != 0)
+    void saveIndex() const
+    {
+        // Written beside a temporary name, an interrupted write leaves no index
+        std::string temporary = indexPath() + ".tmp";
+        std::ofstream index(temporary, std::ios::binary);
+        std::uint64_t size = std::filesystem::file_size(m_path);
+        std::uint64_t stamp = fileStamp();
+        std::uint64_t frames = m_frames.size();
+        index.write(indexMagic, sizeof(indexMagic));
+        index.write(reinterpret_cast<const char *>(&indexVersion), sizeof(indexVersion));
+        index.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        index.write(reinterpret_cast<const char *>(&stamp), sizeof(stamp));
+        index.write(reinterpret_cast<const char *>(&frames), sizeof(frames));
+        index.write(reinterpret_cast<const char *>(m_frames.data()), frames * sizeof(Frame));
+        index.close();
+
+        // A read-only directory only costs a scan at every open
+        std::error_code error;
+        if (index)
+            std::filesystem::rename(temporary, indexPath(), error);
+        else
+            std::filesystem::remove(temporary, error);
+    }
+
+    // Scan the file in large blocks, looking only at the first character of the lines
+    // but at the whole "---<time>" lines
+    void buildIndex()
+    {
+        constexpr size_t blockSize = 1 << 22;
+        std::vector<char> block(blockSize);
+        std::string header;
+        std::uint64_t headerStart = 0;
+        std::uint64_t offset = 0;
+        bool lineStart = true;
+        bool inHeader = false;
+
+        m_partFile.clear();
+        m_partFile.seekg(0);
+        while (m_partFile.read(block.data(), blockSize) || m_partFile.gcount() > 0)
+        {
+            size_t read = m_partFile.gcount();
+            size_t i = 0;
+            while (i < read)
+            {
+                if (!inHeader && lineStart)
                 {
-                    // Detect particle
-                    if (line.at(0) == 'P')
+                    if (block[i] == '-')
                     {
-                        // std::cout << "New particle detected" << std::endl;
-
-                        // Split string by space
-                        char delimiter = ' ';
-                        size_t pos = 0;
-                        std::string token;
-
-                        // Remove Particle name from the string
-                        pos = line.find(delimiter);
-                        line.erase(0, pos + 1);
-
-                        // Here we store the particle position
-                        Vec partPos = {0.0, 0.0, 0.0};
-                        int axis = 0;
-
-                        while ((pos = line.find(delimiter)) != std::string::npos)
-                        {
-                            token = line.substr(0, pos);
-                            line.erase(0, pos + 1);
-
-                            switch (axis)
-                            {
-                            case 0:
-                                partPos.x = stod(token);
-                                axis++;
-                                break;
-                            case 1:
-                                partPos.y = stod(token);
-                                axis++;
-                                break;
-                            case 2:
-                                partPos.z = stod(token);
-                                axis = 0;
-                                break;
-                            default:
-                                break;
-                            }
-                        }
-
-                        // Save particle in current step
-                        tempVec.push_back(partPos);
+                        inHeader = true;
+                        headerStart = offset + i;
                     }
+                    else if (block[i] == 'P' && !m_frames.empty())
+                        m_frames.back().count++;
+                }
 
-                    else if (line.at(0) == '-')
+                const char *newline = static_cast<const char *>(std::memchr(block.data() + i, '\n', read - i));
+                size_t lineEnd = newline ? newline - block.data() : read;
+                if (inHeader)
+                    header.append(block.data() + i, lineEnd - i);
+
+                lineStart = newline != nullptr;
+                i = lineEnd + 1;
+                if (inHeader && newline)
+                {
+                    startFrame(header, headerStart, offset + i);
+                    header.clear();
+                    inHeader = false;
+                }
+            }
+            offset += read;
+        }
+
+        // A last header without its newline
+        if (inHeader)
+            startFrame(header, headerStart, offset);
+        if (!m_frames.empty())
+            m_frames.back().end = offset;
+
+        m_frames.erase(std::remove_if(m_frames.begin(), m_frames.end(), [](const Frame &frame)
+                                      { return !frame.positions; }),
+                       m_frames.end());
+    }
+
+    void startFrame(const std::string &line, std::uint64_t lineStart, std::uint64_t begin)
+    {
+        if (!m_frames.empty())
+            m_frames.back().end = lineStart;
+
+        // Older files may have no time after the dashes
+        size_t dashes = line.find_first_not_of('-');
+        char *end = nullptr;
+        double time = dashes == std::string::npos ? 0.0 : std::strtod(line.c_str() + dashes, &end);
+        if (end == nullptr || end == line.c_str() + dashes)
+            time = m_deltaTime * m_frames.size();
+
+        // The fields follow the time, older files have none and hold positions only.
+        // Positions always come first when they are present
+        std::uint64_t positions = 1;
+        if (end != nullptr && end != line.c_str() + dashes)
+        {
+            std::istringstream fields(end);
+            std::string field;
+            if (fields >> field)
+                positions = field == "pos";
+        }
+
+        m_frames.push_back({time, begin, begin, 0, positions});
+    }
+
+    // Parse the particle lines of frame with one read of the whole frame
+    void readFrame(std::ifstream &file, size_t frame, std::vector<Vec> &positions) const
+    {
+        const Frame &info = m_frames[frame];
+        std::string text(info.end - info.begin, '\0');
+        file.clear();
+        file.seekg(info.begin);
+        file.read(&text[0], text.size());
+        text.resize(file.gcount());
+
+        positions.clear();
+        positions.reserve(info.count);
+
+        const char *cursor = text.c_str();
+        const char *last = cursor + text.size();
+        while (cursor < last)
+        {
+            const char *lineEnd = static_cast<const char *>(std::memchr(cursor, '\n', last - cursor));
+            if (!lineEnd)
+                lineEnd = last;
+
+            if (*cursor == 'P')
+            {
+                // Skip the particle name, then read the three coordinates
+                const char *space = static_cast<const char *>(std::memchr(cursor, ' ', lineEnd - cursor));
+                Vec position = {0.0, 0.0, 0.0};
+                if (space)
+                {
+                    char *next;
+                    position.x = std::strtod(space, &next);
+                    position.y = std::strtod(next, &next);
+                    position.z = std::strtod(next, &next);
+                }
+                positions.push_back(position);
+            }
+            cursor = lineEnd + 1;
+        }
+    }
+
+    void prefetchLoop()
+    {
+        // The worker has its own stream, the reads don't move the one of getFrame
+        std::ifstream file(m_path, std::ios::binary);
+        std::vector<Vec> positions;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            size_t frame = SIZE_MAX;
+            m_changed.wait(lock, [this, &frame]
+                           {
+                if (m_stop)
+                    return true;
+                for (size_t next = m_next; next < m_next + m_prefetch && next < m_frames.size(); ++next)
+                {
+                    if (m_ready.find(next) == m_ready.end())
                     {
-                        // std::cout << "New time step detected" << std::endl;
-                        m_numStep++;
-                        m_particleIndex = 0;
-
-                        if (m_numStep != 0)
-                        {
-                            std::cout << "temp vec size: " << tempVec.size() << std::endl;
-                            m_parsed.push_back(tempVec);
-                            tempVec.clear();
-                        }
-
-                        m_timePassed.push_back(m_deltaTime * m_numStep);
+                        frame = next;
+                        return true;
                     }
                 }
-            }
+                return false; });
+            if (m_stop)
+                return;
+
+            m_loading = frame;
+            lock.unlock();
+            readFrame(file, frame, positions);
+            lock.lock();
+            m_loading = SIZE_MAX;
+
+            // getFrame may have moved on in the meantime
+            if (frame >= m_next && frame < m_next + m_prefetch)
+                m_ready[frame] = std::move(positions);
+            positions = std::vector<Vec>();
+            m_changed.notify_all();
         }
-        // Save also last tempVec
-        m_parsed.push_back(tempVec);
     }
 };
 
-#endif
\ No newline at end of file
+#endif
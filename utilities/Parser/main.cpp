@@ -1,20 +1,19 @@
 #include "Parser.hpp"
 
 int main(int argc, char** argv) {
-    std::vector<std::vector<Vec>> particles_;
-    std::vector<double> time_steps_;
-	size_t iter_;
-    Parser parser = Parser("test.part", 1.0);
-    particles_ = parser.getParticles();
-    time_steps_ = parser.getTime();
-    iter_ = 0;
+    std::string path = argc > 1 ? argv[1] : "test.part";
+    Parser parser = Parser(path, 1.0);
 
-    std::cout << "Number of particles: " << particles_[0].size() << std::endl;
-    std::cout << "Number of time steps: " << time_steps_.size() << std::endl;
-    for(int i = 0; i < particles_[0].size(); ++i) 
+    std::cout << "Number of time steps: " << parser.getFrames() << std::endl;
+    if (parser.getFrames() == 0)
+        return 0;
+
+    const std::vector<Vec> &particles = parser.getFrame(0);
+    std::cout << "Number of particles: " << particles.size() << std::endl;
+    for(size_t i = 0; i < particles.size(); ++i)
     {
-        std::cout << "Particle " << i+1 << " in position: " << particles_[0].at(i).x << " " << particles_[0].at(i).x << " " << particles_[0].at(i).x << std::endl;
-     }
+        std::cout << "Particle " << i+1 << " in position: " << particles[i].x << " " << particles[i].y << " " << particles[i].z << std::endl;
+    }
 
     return 0;
-}
\ No newline at end of file
+}